@@ -0,0 +1,189 @@
+// alphabet.c
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene la compactacion del alfabeto en clases de simbolos.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+#include "alphabet.h"
+#include <string.h>
+
+// Mezcla un valor en una dispersion
+uint64_t alphabet_mix(uint64_t h, uint64_t v)
+{
+	return (h ^ v) * 0x9E3779B97F4A7C15ull;
+}
+
+// Marca los simbolos de las muestras descritas por indices
+void alphabet_mark(bool present[256], const symbol_t* sample_buffer,
+	const size_t sample_length, const index_t* indices, const size_t i_size)
+{
+	sample_iterator_t i;
+	for (i = sample_iterator_begin(); !sample_iterator_equals(i, sample_iterator_end(i_size));
+		i = sample_iterator_next(indices, i))
+	{
+		const index_t* desc = &indices[i.index];
+		const symbol_t* sample = sample_buffer + desc->begin + desc->stride * i.sample;
+		size_t k;
+		for (k = 0; k < sample_length; k++)
+		{
+			present[sample[k]] = true;
+		}
+	}
+}
+
+void alphabet_from_samples(alphabet_t* alphabet, symbol_t symbols,
+	const symbol_t* sample_buffer, const size_t sample_length,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size)
+{
+	bool present[256];
+	memset(present, 0, sizeof(present));
+	alphabet_mark(present, sample_buffer, sample_length, pindices, ip_size);
+	alphabet_mark(present, sample_buffer, sample_length, nindices, in_size);
+
+	alphabet->symbols = symbols;
+	alphabet->classes = 0;
+	memset(alphabet->class_of, ALPHABET_NONE, sizeof(alphabet->class_of));
+	symbol_t a;
+	for (a = 0; a < symbols; a++)
+	{
+		if (!present[a]) continue;
+		alphabet->rep[alphabet->classes] = a;
+		alphabet->class_of[a] = alphabet->classes++;
+	}
+}
+
+// Indica si dos simbolos tienen las mismas transiciones en el NFA
+bool alphabet_same_symbol(const nfa_t* nfa, symbol_t a, symbol_t b)
+{
+	bitset_t x;
+	bitset_t y;
+	state_t q;
+	for (q = 0; q < MAX_STATES; q++)
+	{
+		nfa_get_sucessors(nfa, q, a, &x);
+		nfa_get_sucessors(nfa, q, b, &y);
+		if (!bitset_equals(&x, &y)) return false;
+	}
+	return true;
+}
+
+void alphabet_from_nfa(alphabet_t* alphabet, const nfa_t* nfa)
+{
+	symbol_t symbols = nfa_get_symbols(nfa);
+
+	// firma de las transiciones de cada simbolo, solo se comparan las
+	// transiciones de simbolos con la misma firma
+	uint64_t signature[256];
+	bitset_t succ;
+	symbol_t a;
+	for (a = 0; a < symbols; a++)
+	{
+		uint64_t h = 1;
+		state_t q;
+		for (q = 0; q < MAX_STATES; q++)
+		{
+			nfa_get_sucessors(nfa, q, a, &succ);
+			bucket_index_t i;
+			for (i = 0; i < MAX_BUCKETS; i++)
+			{
+				h = alphabet_mix(h, succ.buckets[i]);
+			}
+		}
+		signature[a] = h;
+	}
+
+	alphabet->symbols = symbols;
+	alphabet->classes = 0;
+	memset(alphabet->class_of, ALPHABET_NONE, sizeof(alphabet->class_of));
+	for (a = 0; a < symbols; a++)
+	{
+		symbol_t c;
+		for (c = 0; c < alphabet->classes; c++)
+		{
+			symbol_t rep = alphabet->rep[c];
+			if (signature[rep] == signature[a] && alphabet_same_symbol(nfa, rep, a)) break;
+		}
+		if (c == alphabet->classes) alphabet->rep[alphabet->classes++] = a;
+		alphabet->class_of[a] = c;
+	}
+}
+
+void alphabet_map(const alphabet_t* alphabet, symbol_t* dst, const symbol_t* src, size_t count)
+{
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		dst[i] = alphabet->class_of[src[i]];
+	}
+}
+
+// Copia los estados iniciales y finales de src en dst
+void alphabet_copy_ends(nfa_t* dst, const nfa_t* src)
+{
+	bitset_t set;
+	bitset_iterator_t j;
+	nfa_get_initials(src, &set);
+	for (j = bitset_first(&set); !bitset_end(j); j = bitset_next(&set, j))
+	{
+		nfa_add_initial(dst, bitset_element(j));
+	}
+	nfa_get_finals(src, &set);
+	for (j = bitset_first(&set); !bitset_end(j); j = bitset_next(&set, j))
+	{
+		nfa_add_final(dst, bitset_element(j));
+	}
+}
+
+bool alphabet_compress(const alphabet_t* alphabet, nfa_t* dst, const nfa_t* src)
+{
+	nfa_init(dst, alphabet->classes);
+	alphabet_copy_ends(dst, src);
+	bitset_t succ;
+	bitset_iterator_t j;
+	state_t q;
+	for (q = 0; q < MAX_STATES; q++)
+	{
+		symbol_t c;
+		for (c = 0; c < alphabet->classes; c++)
+		{
+			nfa_get_sucessors(src, q, alphabet->rep[c], &succ);
+			for (j = bitset_first(&succ); !bitset_end(j); j = bitset_next(&succ, j))
+			{
+				if (!nfa_add_transition(dst, q, bitset_element(j), c)) return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool alphabet_expand(const alphabet_t* alphabet, nfa_t* dst, const nfa_t* src)
+{
+	nfa_init(dst, alphabet->symbols);
+	alphabet_copy_ends(dst, src);
+	bitset_t succ;
+	bitset_iterator_t j;
+	state_t q;
+	for (q = 0; q < MAX_STATES; q++)
+	{
+		symbol_t a;
+		for (a = 0; a < alphabet->symbols; a++)
+		{
+			symbol_t c = alphabet->class_of[a];
+			if (c == ALPHABET_NONE) continue;
+			nfa_get_sucessors(src, q, c, &succ);
+			for (j = bitset_first(&succ); !bitset_end(j); j = bitset_next(&succ, j))
+			{
+				if (!nfa_add_transition(dst, q, bitset_element(j), a)) return false;
+			}
+		}
+	}
+	return true;
+}
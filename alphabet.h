@@ -0,0 +1,67 @@
+// alphabet.h
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene la compactacion del alfabeto: asigna identificadores
+// densos a los simbolos que aparecen en las muestras y agrupa en clases los
+// simbolos con las mismas transiciones en un NFA, de manera que las tablas,
+// las mezclas y las simulaciones trabajan por clase y no por simbolo.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+//------------------------------------------------------------------------------
+#pragma once
+#include "nfa.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Clase de los simbolos que no pertenecen a ninguna clase, es decir que no
+// tienen transiciones en el automata compacto
+#define ALPHABET_NONE 255u
+
+// Particion de un alfabeto en clases. El automata compacto usa la clase c
+// como simbolo, y cada simbolo a del alfabeto original se comporta como su
+// clase class_of[a]
+typedef struct _alphabet_t
+{
+	// Simbolos del alfabeto original
+	symbol_t symbols;
+	// Cantidad de clases, que son los simbolos del alfabeto compacto
+	symbol_t classes;
+	// Clase de cada simbolo o ALPHABET_NONE
+	uint8_t class_of[256];
+	// Un simbolo de cada clase
+	symbol_t rep[256];
+} alphabet_t;
+
+// Asigna una clase a cada simbolo que aparece en las muestras, en orden
+// creciente de simbolo. Los demas quedan en ALPHABET_NONE: OIL solo crea
+// transiciones con simbolos de las muestras
+void alphabet_from_samples(alphabet_t* alphabet, symbol_t symbols,
+	const symbol_t* sample_buffer, const size_t sample_length,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size);
+
+// Agrupa en clases los simbolos con las mismas transiciones en el NFA, en
+// orden del primer simbolo de cada clase. Todos los simbolos tienen clase
+void alphabet_from_nfa(alphabet_t* alphabet, const nfa_t* nfa);
+
+// Traduce count simbolos de src a su clase en dst. Los simbolos sin clase
+// quedan en ALPHABET_NONE y no deben ser simulados
+void alphabet_map(const alphabet_t* alphabet, symbol_t* dst, const symbol_t* src, size_t count);
+
+// Construye en dst el NFA sobre las clases: la clase c tiene las
+// transiciones de rep[c] en src. dst se inicializa como con nfa_init.
+// Retorna false si las transiciones no caben en dst
+bool alphabet_compress(const alphabet_t* alphabet, nfa_t* dst, const nfa_t* src);
+
+// Construye en dst el NFA sobre el alfabeto original: cada simbolo tiene las
+// transiciones de su clase en src, y los simbolos sin clase no tienen.
+// dst se inicializa como con nfa_init. Retorna false si las transiciones no
+// caben en dst
+bool alphabet_expand(const alphabet_t* alphabet, nfa_t* dst, const nfa_t* src);
@@ -0,0 +1,433 @@
+// bench.c
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene pruebas de rendimiento de las rutinas que mas
+// tiempo consumen. Se compila de manera nativa (make bench) y reporta los
+// resultados en formato CSV para poder compararlos entre versiones.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M. 
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata 
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "bitset.h"
+#include "nfa.h"
+#include "dfa.h"
+#ifdef OIL_THREADS
+#include "workers.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// BENCH
+
+// Tiempo minimo que debe durar cada medicion
+#define BENCH_MIN_NS 200000000ull
+
+// Cantidad de muestras y de conjuntos usados en las mediciones
+#define BENCH_SAMPLES 1024
+#define BENCH_SETS 1024
+
+uint8_t bsf32(uint32_t bus);
+
+// Generador pseudoaleatorio propio para que los datos sean reproducibles
+uint32_t bench_rand_state = 12345;
+uint32_t bench_rand(void)
+{
+	bench_rand_state = bench_rand_state * 1103515245u + 12345u;
+	return bench_rand_state >> 8;
+}
+
+// Tiempo actual en nanosegundos
+uint64_t bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Operacion a medir, repetida reps veces. Retorna el tiempo medido en
+// nanosegundos, o 0 para que se mida el tiempo de toda la llamada
+typedef uint64_t (*bench_op_t)(void* ctx, uint64_t reps);
+
+// Mide una operacion duplicando las repeticiones hasta superar BENCH_MIN_NS
+// y escribe una fila de resultados.
+// samples_per_op: muestras procesadas en cada operacion
+// bytes_per_op: bytes copiados en cada operacion
+void bench_run(const char* kernel, bench_op_t op, void* ctx,
+	double samples_per_op, double bytes_per_op)
+{
+	uint64_t reps = 1;
+	uint64_t elapsed;
+	for (;;)
+	{
+		uint64_t t0 = bench_now();
+		elapsed = op(ctx, reps);
+		if (elapsed == 0) elapsed = bench_now() - t0;
+		if (elapsed >= BENCH_MIN_NS) break;
+		reps *= 2;
+	}
+	double ns_per_op = (double)elapsed / reps;
+	printf("%s,%u,%llu,%.2f,%.0f,%.0f\n", kernel, BITSET_BITS,
+		(unsigned long long)reps, ns_per_op,
+		samples_per_op * 1e9 / ns_per_op, bytes_per_op);
+}
+
+// Datos compartidos por todas las mediciones
+typedef struct _bench_ctx_t
+{
+	nfa_t nfa;
+	nfa_t copy;
+	nfa_merge_log_t log;
+	symbol_t buffer[BENCH_SAMPLES * 255];
+	index_t index;
+	uint16_t length;
+	uint32_t words[BENCH_SETS];
+	bitset_t sets[BENCH_SETS];
+	nfa_cache_t cache;
+	dfa_t dfa;
+	dfa_classifier_t classifier;
+	const symbol_t* inputs[BENCH_SAMPLES];
+	uint16_t lengths[BENCH_SAMPLES];
+	uint64_t results[BENCH_SAMPLES / 64];
+	// hilos de dfa_classify, NULL si se clasifica en el hilo actual
+	struct _workers_t* workers;
+#ifdef OIL_THREADS
+	workers_t pool;
+#endif
+	volatile uint32_t sink;
+} bench_ctx_t;
+
+uint64_t bench_bsf32(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint32_t sum = 0;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		int i;
+		for (i = 0; i < BENCH_SETS; i++)
+		{
+			sum += bsf32(ctx->words[i]);
+		}
+	}
+	ctx->sink = sum;
+	return 0;
+}
+
+uint64_t bench_bitset_iterate(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint32_t sum = 0;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		int i;
+		for (i = 0; i < BENCH_SETS; i++)
+		{
+			const bitset_t* bs = &ctx->sets[i];
+			bitset_iterator_t j;
+			for (j = bitset_first(bs); !bitset_end(j); j = bitset_next(bs, j))
+			{
+				sum += bitset_element(j);
+			}
+		}
+	}
+	ctx->sink = sum;
+	return 0;
+}
+
+uint64_t bench_nfa_clone(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		nfa_clone(&ctx->copy, &ctx->nfa);
+	}
+	return 0;
+}
+
+// Solo se mide la mezcla, la copia previa no se cuenta
+uint64_t bench_nfa_merge_states(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint64_t elapsed = 0;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		state_t q1 = bench_rand() % MAX_STATES;
+		state_t q2 = (q1 + 1 + bench_rand() % (MAX_STATES - 1)) % MAX_STATES;
+		nfa_clone(&ctx->copy, &ctx->nfa);
+		uint64_t t0 = bench_now();
+		nfa_merge_states(&ctx->copy, q1, q2);
+		elapsed += bench_now() - t0;
+	}
+	return elapsed > 0 ? elapsed : 1;
+}
+
+uint64_t bench_nfa_merge_rollback(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		state_t q1 = r % MAX_STATES;
+		state_t q2 = (q1 + 1 + r % (MAX_STATES - 1)) % MAX_STATES;
+		nfa_merge_states_logged(&ctx->nfa, q1, q2, &ctx->log);
+		nfa_merge_rollback(&ctx->nfa, &ctx->log);
+	}
+	return 0;
+}
+
+uint64_t bench_nfa_accept_sample(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint32_t sum = 0;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		int i;
+		for (i = 0; i < BENCH_SAMPLES; i++)
+		{
+			sum += nfa_accept_sample(&ctx->nfa, ctx->buffer + i * ctx->length, ctx->length);
+		}
+	}
+	ctx->sink = sum;
+	return 0;
+}
+
+// Igual que bench_nfa_accept_sample con la copia en la disposicion por
+// simbolo, que simula con el nucleo de nfa_step
+uint64_t bench_nfa_accept_sample_matrix(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint32_t sum = 0;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		int i;
+		for (i = 0; i < BENCH_SAMPLES; i++)
+		{
+			sum += nfa_accept_sample(&ctx->copy, ctx->buffer + i * ctx->length, ctx->length);
+		}
+	}
+	ctx->sink = sum;
+	return 0;
+}
+
+// La cache se invalida en cada repeticion, como si el automata cambiara
+// entre cada evaluacion de las muestras
+uint64_t bench_nfa_accept_sample_cached(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint32_t sum = 0;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		nfa_cache_invalidate(&ctx->cache);
+		int i;
+		for (i = 0; i < BENCH_SAMPLES; i++)
+		{
+			sum += nfa_accept_sample_cached(&ctx->nfa, &ctx->cache,
+				ctx->buffer + i * ctx->length, ctx->length);
+		}
+	}
+	ctx->sink = sum;
+	return 0;
+}
+
+uint64_t bench_dfa_accept_sample(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint32_t sum = 0;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		int i;
+		for (i = 0; i < BENCH_SAMPLES; i++)
+		{
+			sum += dfa_accept_sample(&ctx->dfa, ctx->buffer + i * ctx->length, ctx->length);
+		}
+	}
+	ctx->sink = sum;
+	return 0;
+}
+
+uint64_t bench_dfa_classify(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint32_t sum = 0;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		dfa_classify(&ctx->classifier, ctx->inputs, ctx->lengths, BENCH_SAMPLES,
+			ctx->results, ctx->workers);
+		sum += (uint32_t)ctx->results[0];
+	}
+	ctx->sink = sum;
+	return 0;
+}
+
+uint64_t bench_nfa_accept_samples(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint32_t sum = 0;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		sum += nfa_accept_samples(&ctx->nfa, ctx->buffer, BENCH_SAMPLES * ctx->length,
+			ctx->length, &ctx->index, 1,
+			sample_iterator_begin(), sample_iterator_end(1));
+	}
+	ctx->sink = sum;
+	return 0;
+}
+
+uint64_t bench_nfa_accept_all_samples(void* p, uint64_t reps)
+{
+	bench_ctx_t* ctx = (bench_ctx_t*)p;
+	uint32_t sum = 0;
+	uint64_t r;
+	for (r = 0; r < reps; r++)
+	{
+		sum += nfa_accept_all_samples(&ctx->nfa, ctx->buffer, BENCH_SAMPLES * ctx->length,
+			ctx->length, &ctx->index, 1,
+			sample_iterator_begin(), sample_iterator_end(1));
+	}
+	ctx->sink = sum;
+	return 0;
+}
+
+// Construye un automata aleatorio con degree sucesores promedio por cada
+// par estado-simbolo y muestras aleatorias
+void bench_setup(bench_ctx_t* ctx, symbol_t symbols, uint16_t length, int degree)
+{
+	nfa_init(&ctx->nfa, symbols);
+	state_t q;
+	for (q = 0; q < MAX_STATES; q++)
+	{
+		symbol_t a;
+		for (a = 0; a < symbols; a++)
+		{
+			int d;
+			for (d = 0; d < degree; d++)
+			{
+				nfa_add_transition(&ctx->nfa, q, bench_rand() % MAX_STATES, a);
+			}
+		}
+		if (bench_rand() % 8 == 0) nfa_add_initial(&ctx->nfa, q);
+		if (bench_rand() % 2 == 0) nfa_add_final(&ctx->nfa, q);
+	}
+	nfa_add_initial(&ctx->nfa, 0);
+
+	ctx->length = length;
+	int i;
+	for (i = 0; i < BENCH_SAMPLES * length; i++)
+	{
+		ctx->buffer[i] = bench_rand() % symbols;
+	}
+	ctx->index.begin = 0;
+	ctx->index.samples = BENCH_SAMPLES;
+	ctx->index.stride = length;
+	nfa_cache_init(&ctx->cache);
+	for (i = 0; i < BENCH_SAMPLES; i++)
+	{
+		ctx->inputs[i] = ctx->buffer + i * length;
+		ctx->lengths[i] = length;
+	}
+
+	for (i = 0; i < BENCH_SETS; i++)
+	{
+		ctx->words[i] = bench_rand() | 1u << (bench_rand() % 32);
+		bitset_init(&ctx->sets[i]);
+		int k;
+		for (k = 0; k < 8; k++)
+		{
+			bitset_add(&ctx->sets[i], bench_rand() % MAX_STATES);
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MAIN
+
+// Uso: bench [simbolos] [longitud de muestra] [sucesores por simbolo] [hilos]
+int main(int argc, char** argv)
+{
+	// se validan como int antes de reducirlos a su tipo
+	int symbols_arg = argc > 1 ? atoi(argv[1]) : 4;
+	int length_arg = argc > 2 ? atoi(argv[2]) : 16;
+	int degree = argc > 3 ? atoi(argv[3]) : 1;
+	int threads = argc > 4 ? atoi(argv[4]) : 1;
+	if (symbols_arg < 1 || symbols_arg > (int)MAX_SYMBOLS || length_arg < 1 || length_arg > 255 || threads < 1)
+	{
+		fprintf(stderr, "usage: %s [symbols] [sample_length] [degree] [threads]\n", argv[0]);
+		return 1;
+	}
+	symbol_t symbols = (symbol_t)symbols_arg;
+	uint16_t length = (uint16_t)length_arg;
+
+	bench_ctx_t* ctx = (bench_ctx_t*)malloc(sizeof(bench_ctx_t));
+	if (ctx == NULL || !nfa_merge_log_init(&ctx->log, symbols))
+	{
+		free(ctx);
+		return 1;
+	}
+	nfa_init(&ctx->copy, symbols);
+	bench_setup(ctx, symbols, length, degree);
+	ctx->workers = NULL;
+#ifdef OIL_THREADS
+	if (threads > MAX_WORKERS) threads = MAX_WORKERS;
+	// si no se pueden crear los hilos, se clasifica en el hilo actual
+	if (threads > 1)
+	{
+		if (workers_init(&ctx->pool, threads)) ctx->workers = &ctx->pool;
+		else workers_destroy(&ctx->pool);
+	}
+#endif
+
+	printf("kernel,bits,ops,ns_per_op,samples_per_s,bytes_per_op\n");
+	bench_run("bsf32", bench_bsf32, ctx, BENCH_SETS, 0);
+	bench_run("bitset_iterate", bench_bitset_iterate, ctx, BENCH_SETS, 0);
+	bench_run("nfa_clone", bench_nfa_clone, ctx, 0, nfa_clone_size(&ctx->nfa));
+	bench_run("nfa_merge_states", bench_nfa_merge_states, ctx, 0, 0);
+	bench_run("nfa_merge_rollback", bench_nfa_merge_rollback, ctx, 0, 0);
+	bench_run("nfa_accept_sample", bench_nfa_accept_sample, ctx, BENCH_SAMPLES, 0);
+	// la fila lleva el nombre del nucleo escogido
+	char kernel[64];
+	snprintf(kernel, sizeof(kernel), "nfa_accept_sample_%s", nfa_step_kernel());
+	nfa_clone(&ctx->copy, &ctx->nfa);
+	nfa_set_sparse(&ctx->copy, false);
+	nfa_set_symbol_major(&ctx->copy, true);
+	bench_run(kernel, bench_nfa_accept_sample_matrix, ctx, BENCH_SAMPLES, 0);
+	bench_run("nfa_accept_sample_cached", bench_nfa_accept_sample_cached, ctx, BENCH_SAMPLES, 0);
+	bench_run("nfa_accept_samples", bench_nfa_accept_samples, ctx, BENCH_SAMPLES, 0);
+	// sin fila si el DFA supera el limite de tamano
+	if (dfa_compile(&ctx->dfa, &ctx->nfa, DFA_MAX_BYTES))
+	{
+		bench_run("dfa_accept_sample", bench_dfa_accept_sample, ctx, BENCH_SAMPLES, 0);
+		dfa_free(&ctx->dfa);
+	}
+	// usa el DFA si cabe en el limite, de lo contrario el NFA
+	dfa_classifier_init(&ctx->classifier, &ctx->nfa, DFA_MAX_BYTES);
+	bench_run("dfa_classify", bench_dfa_classify, ctx, BENCH_SAMPLES, 0);
+	dfa_classifier_free(&ctx->classifier);
+#ifdef OIL_THREADS
+	if (ctx->workers != NULL) workers_destroy(ctx->workers);
+#endif
+	// se detiene en la primera muestra rechazada, no se reportan muestras
+	bench_run("nfa_accept_all_samples", bench_nfa_accept_all_samples, ctx, 0, 0);
+
+	nfa_merge_log_free(&ctx->log);
+	nfa_free(&ctx->nfa);
+	nfa_free(&ctx->copy);
+	free(ctx);
+	return 0;
+}
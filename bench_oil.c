@@ -0,0 +1,419 @@
+// bench_oil.c
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene una prueba de escalamiento del algoritmo completo.
+// Genera un lenguaje objetivo aleatorio (un DFA o un NFA) y muestras
+// positivas y negativas etiquetadas con el, al estilo de Abbadingo, y
+// ejecuta oil() para tamanos crecientes de muestra. Los resultados se
+// reportan en formato CSV.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M. 
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata 
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "nfa.h"
+#include "oil.h"
+#include "model.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// GENERADOR
+
+// Cantidad maxima de estados del lenguaje objetivo
+#define MAX_TARGET_STATES 64
+
+// Cantidad maxima de muestras de cada tamano del barrido
+#define MAX_SWEEP 32
+
+// Lenguaje objetivo. En un DFA cada par estado-simbolo tiene exactamente un
+// sucesor, en un NFA puede tener varios o ninguno
+typedef struct _target_t
+{
+	int states;
+	symbol_t symbols;
+	// next[q][a] es el conjunto de sucesores como mascara de bits
+	uint64_t next[MAX_TARGET_STATES][MAX_SYMBOLS];
+	uint64_t initials;
+	uint64_t finals;
+} target_t;
+
+// Parametros de la prueba
+typedef struct _scaling_config_t
+{
+	symbol_t symbols;
+	uint16_t length;
+	int target_states;
+	bool target_nfa;
+	int threads;
+	bool use_trie;
+	bool reduce;
+	// aprende sobre el alfabeto compacto de las muestras
+	bool compact_alphabet;
+	// usa la disposicion por simbolo de las tablas densas
+	bool symbol_major;
+	// simbolos del alfabeto en que se escriben las muestras, el simbolo a
+	// del lenguaje objetivo se escribe como a * width / symbols
+	int width;
+	int restarts;
+	bool cancel;
+	// lotes en que se entregan las muestras al aprendiz incremental
+	int batches;
+	unsigned seed;
+	// imprime los contadores de cada fila en stderr (requiere OIL_METRICS)
+	bool metrics;
+	// si no es NULL, guarda el modelo aprendido en cada fila
+	const char* model_path;
+	// checkpoints de la ejecucion, ver oil_config_t
+	const char* checkpoint_path;
+	uint32_t checkpoint_interval;
+	bool resume;
+	int sizes[MAX_SWEEP];
+	int sweep;
+} scaling_config_t;
+
+// Generador pseudoaleatorio propio para que los datos sean reproducibles
+uint64_t scaling_rand_state;
+uint32_t scaling_rand(void)
+{
+	scaling_rand_state = scaling_rand_state * 6364136223846793005ull + 1442695040888963407ull;
+	return (uint32_t)(scaling_rand_state >> 33);
+}
+
+// Genera un lenguaje objetivo aleatorio
+void target_generate(target_t* t, int states, symbol_t symbols, bool nfa)
+{
+	t->states = states;
+	t->symbols = symbols;
+	t->initials = 1;
+	t->finals = 0;
+	int q;
+	for (q = 0; q < states; q++)
+	{
+		if (scaling_rand() % 2) t->finals |= 1ull << q;
+		symbol_t a;
+		for (a = 0; a < symbols; a++)
+		{
+			t->next[q][a] = 1ull << (scaling_rand() % states);
+			if (nfa && scaling_rand() % 2)
+			{
+				t->next[q][a] |= 1ull << (scaling_rand() % states);
+			}
+		}
+	}
+	// evita lenguajes triviales
+	if (t->finals == 0) t->finals = 1ull << (states - 1);
+}
+
+// Indica si el lenguaje objetivo contiene la secuencia
+bool target_accept(const target_t* t, const symbol_t* sample, uint16_t length)
+{
+	uint64_t current = t->initials;
+	uint16_t i;
+	for (i = 0; i < length && current; i++)
+	{
+		uint64_t next = 0;
+		int q;
+		for (q = 0; q < t->states; q++)
+		{
+			if ((current >> q) & 1) next |= t->next[q][sample[i]];
+		}
+		current = next;
+	}
+	return (current & t->finals) != 0;
+}
+
+// Llena el buffer con count muestras positivas seguidas de count negativas.
+// Retorna false si el lenguaje objetivo no produce suficientes muestras
+// de alguna de las dos clases
+bool scaling_samples(const target_t* t, symbol_t* buffer, uint16_t length, int count)
+{
+	int positives = 0;
+	int negatives = 0;
+	long tries = 0;
+	symbol_t sample[255];
+	while ((positives < count || negatives < count) && tries++ < 1000L * count)
+	{
+		uint16_t i;
+		for (i = 0; i < length; i++)
+		{
+			sample[i] = scaling_rand() % t->symbols;
+		}
+		if (target_accept(t, sample, length))
+		{
+			if (positives == count) continue;
+			memcpy(buffer + (size_t)positives * length, sample, length);
+			positives++;
+		}
+		else
+		{
+			if (negatives == count) continue;
+			memcpy(buffer + (size_t)(count + negatives) * length, sample, length);
+			negatives++;
+		}
+	}
+	return positives == count && negatives == count;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// PRUEBA
+
+// Tiempo actual en nanosegundos
+uint64_t scaling_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Ejecuta oil() con count muestras positivas y count negativas y escribe una
+// fila de resultados
+void scaling_run(const scaling_config_t* config, const target_t* target, int count)
+{
+	uint16_t length = config->length;
+	symbol_t* buffer = (symbol_t*)malloc((size_t)2 * count * length);
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	if (buffer == NULL || nfa == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	if (!scaling_samples(target, buffer, length, count))
+	{
+		fprintf(stderr, "target language does not yield %d samples of each class\n", count);
+		free(buffer);
+		free(nfa);
+		return;
+	}
+	symbol_t symbols = config->symbols;
+	if (config->width > config->symbols)
+	{
+		size_t i;
+		for (i = 0; i < (size_t)2 * count * length; i++)
+		{
+			buffer[i] = (symbol_t)(buffer[i] * config->width / config->symbols);
+		}
+		symbols = (symbol_t)config->width;
+	}
+
+	index_t pindex;
+	pindex.begin = 0;
+	pindex.samples = count;
+	pindex.stride = length;
+	index_t nindex;
+	nindex.begin = (uint32_t)count * length;
+	nindex.samples = count;
+	nindex.stride = length;
+
+	oil_stats_t stats;
+	oil_config_t oil_config;
+	oil_config_init(&oil_config);
+	oil_config.threads = config->threads;
+	oil_config.use_trie = config->use_trie;
+	oil_config.reduce = config->reduce;
+	oil_config.compact_alphabet = config->compact_alphabet;
+	oil_config.symbol_major = config->symbol_major;
+	oil_config.seed = config->seed;
+	oil_config.stats = &stats;
+	oil_metrics_t metrics;
+	oil_metrics_init(&metrics);
+	if (config->metrics) oil_config.metrics = &metrics;
+	oil_config.checkpoint_path = config->checkpoint_path;
+	oil_config.checkpoint_interval = config->checkpoint_interval;
+	oil_config.resume = config->resume;
+
+	nfa_init(nfa, symbols);
+	uint64_t t0 = scaling_now();
+	bool complete;
+	if (config->batches > 1)
+	{
+		// cada lote agrega una fraccion de las positivas y de las negativas
+		oil_learner_t* learner = oil_learner_create(&oil_config, symbols, length, nfa);
+		complete = learner != NULL;
+		int b;
+		for (b = 0; complete && b < config->batches; b++)
+		{
+			int first = count * b / config->batches;
+			int last = count * (b + 1) / config->batches;
+			index_t pbatch = pindex;
+			pbatch.begin += (uint32_t)first * length;
+			pbatch.samples = last - first;
+			index_t nbatch = nindex;
+			nbatch.begin += (uint32_t)first * length;
+			nbatch.samples = last - first;
+			complete = oil_learner_update(learner, buffer, (size_t)2 * count * length,
+				&pbatch, pbatch.samples > 0, &nbatch, nbatch.samples > 0);
+		}
+		if (learner != NULL) oil_learner_free(learner);
+	}
+	else if (config->restarts > 1)
+	{
+		complete = oil_restarts(buffer, (size_t)2 * count * length, length, symbols,
+			&pindex, 1, &nindex, 1, &oil_config, config->restarts, config->cancel, nfa);
+	}
+	else
+	{
+		complete = oil_ex(buffer, (size_t)2 * count * length, length, symbols,
+			&pindex, 1, &nindex, 1, &oil_config, nfa);
+	}
+	uint64_t elapsed = scaling_now() - t0;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf("%d,%d,%u,%u,%d,%s,%d,%d,%.3f,%llu,%llu,%u,%ld,%d\n",
+		count, count, config->symbols, config->length,
+		config->target_states, config->target_nfa ? "nfa" : "dfa",
+		config->threads, config->restarts, elapsed / 1e6,
+		(unsigned long long)stats.merges_attempted,
+		(unsigned long long)stats.merges_accepted,
+		stats.states, usage.ru_maxrss, complete ? 1 : 0);
+	fflush(stdout);
+	if (config->metrics) oil_metrics_json(&metrics, stderr);
+	if (config->model_path != NULL && complete)
+	{
+		// el DFA se incluye si cabe en el limite de tamano
+		dfa_t dfa;
+		bool compiled = dfa_compile(&dfa, nfa, DFA_MAX_BYTES);
+		if (!model_save(config->model_path, nfa, compiled ? &dfa : NULL))
+		{
+			fprintf(stderr, "could not write %s\n", config->model_path);
+		}
+		if (compiled) dfa_free(&dfa);
+	}
+
+	free(buffer);
+	nfa_free(nfa);
+	free(nfa);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// MAIN
+
+void scaling_usage(const char* name)
+{
+	fprintf(stderr,
+		"usage: %s [-k symbols] [-l length] [-s target_states] [-n] [-t threads]\n"
+		"          [-p] [-x] [-R restarts] [-c] [-r seed] [-m] [-o model]\n"
+		"          [-C checkpoint] [-i interval] [-u] [-b batches]\n"
+		"          [-a] [-w width] [-M] [samples_per_class ...]\n"
+		"  -n  the target language is a random NFA instead of a DFA\n"
+		"  -p  evaluate merges over a prefix trie of the samples\n"
+		"  -x  reduce the learned NFA (trim and bisimulation merges)\n"
+		"  -R  keep the smallest NFA of several seeded runs, one per thread\n"
+		"  -c  cancel runs that exceed the best state count found so far\n"
+		"  -m  print the learning metrics of each row as JSON to stderr\n"
+		"      (build with OIL_METRICS=1)\n"
+		"  -o  write the learned model of each row to a binary model file\n"
+		"  -C  save the learner state to a checkpoint file while running\n"
+		"  -i  positive samples added between checkpoints (default 1)\n"
+		"  -u  resume from the checkpoint file if it exists\n"
+		"  -b  feed the samples to the incremental learner in several batches\n"
+		"  -a  learn over the compact alphabet of the samples\n"
+		"  -w  write the samples over an alphabet of width symbols\n"
+		"  -M  store the transitions of each symbol as a bit matrix\n",
+		name);
+}
+
+int main(int argc, char** argv)
+{
+	scaling_config_t config;
+	config.symbols = 2;
+	config.length = 8;
+	config.target_states = 4;
+	config.target_nfa = false;
+	config.threads = 1;
+	config.use_trie = false;
+	config.reduce = false;
+	config.compact_alphabet = false;
+	config.symbol_major = false;
+	config.width = 0;
+	config.restarts = 1;
+	config.cancel = false;
+	config.batches = 1;
+	config.seed = 1;
+	config.metrics = false;
+	config.model_path = NULL;
+	config.checkpoint_path = NULL;
+	config.checkpoint_interval = 1;
+	config.resume = false;
+	config.sweep = 0;
+
+	// se validan como int antes de reducirlos a su tipo en config
+	int symbols = config.symbols;
+	int length = config.length;
+	int opt;
+	while ((opt = getopt(argc, argv, "k:l:s:nt:pxR:cr:mo:C:i:ub:aw:Mh")) != -1)
+	{
+		switch (opt)
+		{
+		case 'k': symbols = atoi(optarg); break;
+		case 'l': length = atoi(optarg); break;
+		case 's': config.target_states = atoi(optarg); break;
+		case 'n': config.target_nfa = true; break;
+		case 't': config.threads = atoi(optarg); break;
+		case 'p': config.use_trie = true; break;
+		case 'x': config.reduce = true; break;
+		case 'R': config.restarts = atoi(optarg); break;
+		case 'c': config.cancel = true; break;
+		case 'r': config.seed = atoi(optarg); break;
+		case 'm': config.metrics = true; break;
+		case 'o': config.model_path = optarg; break;
+		case 'C': config.checkpoint_path = optarg; break;
+		case 'i': config.checkpoint_interval = atoi(optarg); break;
+		case 'u': config.resume = true; break;
+		case 'b': config.batches = atoi(optarg); break;
+		case 'a': config.compact_alphabet = true; break;
+		case 'w': config.width = atoi(optarg); break;
+		case 'M': config.symbol_major = true; break;
+		default: scaling_usage(argv[0]); return 1;
+		}
+	}
+	for (; optind < argc && config.sweep < MAX_SWEEP; optind++)
+	{
+		config.sizes[config.sweep++] = atoi(argv[optind]);
+	}
+	if (config.sweep == 0)
+	{
+		int size;
+		for (size = 25; size <= 400; size *= 2)
+		{
+			config.sizes[config.sweep++] = size;
+		}
+	}
+	if (symbols < 1 || symbols > (int)MAX_SYMBOLS ||
+		config.width > (int)MAX_SYMBOLS ||
+		length < 1 || length > 255 ||
+		config.target_states < 1 || config.target_states > MAX_TARGET_STATES)
+	{
+		scaling_usage(argv[0]);
+		return 1;
+	}
+	config.symbols = (symbol_t)symbols;
+	config.length = (uint16_t)length;
+
+	scaling_rand_state = config.seed;
+	target_t* target = (target_t*)malloc(sizeof(target_t));
+	if (target == NULL) return 1;
+	target_generate(target, config.target_states, config.symbols, config.target_nfa);
+
+	printf("positives,negatives,symbols,length,target_states,target,threads,restarts,"
+		"wall_ms,merges_attempted,merges_accepted,final_states,peak_rss_kb,complete\n");
+	int i;
+	for (i = 0; i < config.sweep; i++)
+	{
+		if (config.sizes[i] < 1 || config.sizes[i] > UINT16_MAX) continue;
+		scaling_run(&config, target, config.sizes[i]);
+	}
+	free(target);
+	return 0;
+}
@@ -50,6 +50,26 @@ uint8_t bsf32(uint32_t bus)
 	{
 		if((bus >> i)&1) return i;
 	}
+	return 0;
+}
+
+// Obtiene el indice del primer bit encendido en un bucket
+bucket_bit_index_t bucket_bsf(bucket_t bus)
+{
+#ifdef BITSET_BUILTINS
+	assert(bus != 0);
+#if BUCKET_BITS == 32
+	return __builtin_ctz(bus);
+#else
+	return __builtin_ctzll(bus);
+#endif
+#else
+#if BUCKET_BITS == 32
+	return bsf32(bus);
+#else
+	return bsf64(bus);
+#endif
+#endif
 }
 
 void _conformance_check_bitset(void)
@@ -84,7 +104,7 @@ void bitset_remove(bitset_t* set, bitset_element_index_t i)
 
 	assert(bucket < MAX_BUCKETS);
 
-	set->buckets[bucket] &= ~(1 << bit);
+	set->buckets[bucket] &= ~((bucket_t)1 << bit);
 }
 
 // Elimina un elemento indicado por un iterador del bitset
@@ -94,7 +114,7 @@ void bitset_remove_iterator(bitset_t* set, bitset_iterator_t i)
 	assert(i.bucket_index < MAX_BUCKETS);
 	assert(i.bit < BITS_OF_TYPE(bucket_t));
 
-	set->buckets[i.bucket_index] &= ~(1 << i.bit);
+	set->buckets[i.bucket_index] &= ~((bucket_t)1 << i.bit);
 }
 
 // Agrega un elemento a un conjunto
@@ -105,7 +125,7 @@ void bitset_add(bitset_t* set, bitset_element_index_t i)
 
 	assert(bucket < MAX_BUCKETS);
 
-	set->buckets[bucket] |= (1 << bit);
+	set->buckets[bucket] |= ((bucket_t)1 << bit);
 }
 
 // Agrega un rango de elementos al conjunto
@@ -124,7 +144,7 @@ void bitset_add_iterator(bitset_t* set, bitset_iterator_t i)
 	assert(i.bucket_index < MAX_BUCKETS);
 	assert(i.bit < BITS_OF_TYPE(bucket_t));
 
-	set->buckets[i.bucket_index] |= (1 << i.bit);
+	set->buckets[i.bucket_index] |= ((bucket_t)1 << i.bit);
 }
 
 // Prueba si un elemento esta contenido en conjunto de bits
@@ -161,12 +181,26 @@ void bitset_intersect(bitset_t* ra, const bitset_t* b)
 // Comprueba si existe al menos un elemento en el conjunto
 bool bitset_any(const bitset_t* set)
 {
+	// se acumula sin saltos para que el ciclo pueda vectorizarse
+	bucket_t any = 0;
+	bucket_index_t i;
+	for (i=0; i < MAX_BUCKETS; i++)
+	{
+		any |= set->buckets[i];
+	}
+	return any != 0;
+}
+
+// Comprueba si dos conjuntos tienen los mismos elementos
+bool bitset_equals(const bitset_t* a, const bitset_t* b)
+{
+	bucket_t diff = 0;
 	bucket_index_t i;
 	for (i=0; i < MAX_BUCKETS; i++)
 	{
-		if (set->buckets[i]) return true;
+		diff |= a->buckets[i] ^ b->buckets[i];
 	}
-	return false;
+	return diff == 0;
 }
 
 // Obtiene el elemento apuntado por un iterador
@@ -188,7 +222,7 @@ bitset_iterator_t bitset_first(const bitset_t* set)
 		r.bucket = set->buckets[r.bucket_index];
 		if(r.bucket != 0)
 		{
-			r.bit = bsf32(r.bucket);
+			r.bit = bucket_bsf(r.bucket);
 			return r;
 		}
 	}
@@ -207,20 +241,16 @@ bitset_iterator_t bitset_next(const bitset_t* set, bitset_iterator_t r)
 	r.bucket &= r.bucket - 1;
 	if(r.bucket != 0)
 	{
-		r.bit = bsf32(r.bucket);
+		r.bit = bucket_bsf(r.bucket);
 		return r;
 	}
-	bucket_index_t bound = r.bucket_index;
-	for(r.bucket_index=0; r.bucket_index < MAX_BUCKETS; r.bucket_index++)
+	for(r.bucket_index++; r.bucket_index < MAX_BUCKETS; r.bucket_index++)
 	{
-		if(r.bucket_index > bound)
+		r.bucket = set->buckets[r.bucket_index];
+		if(r.bucket != 0)
 		{
-			r.bucket = set->buckets[r.bucket_index];
-			if(r.bucket != 0)
-			{
-				r.bit = bsf32(r.bucket);
-				return r;
-			}
+			r.bit = bucket_bsf(r.bucket);
+			return r;
 		}
 	}
 	r.end = true;
@@ -21,12 +21,34 @@
 /////////////////////////////////////////////////////////////////////////////
 // Bitset
 // Requiere configurar:
+// - BITSET_BITS
+// El resto se deriva de BITSET_BITS:
 // - bucket_t
 // - MAX_BUCKETS
 // - bucket_bit_index_t
-
-// Es un bucket del bitset
+// - bitset_element_index_t
+
+// Cantidad de bits en un conjunto. Debe ser uno de 64, 128, 256, 512 o 4096.
+// Limita la cantidad de estados del NFA, por lo que conviene compilar con el
+// menor valor que sea suficiente para el problema (-DBITSET_BITS=N)
+#ifndef BITSET_BITS
+#define BITSET_BITS 64
+#endif
+
+#if BITSET_BITS != 64 && BITSET_BITS != 128 && BITSET_BITS != 256 && \
+	BITSET_BITS != 512 && BITSET_BITS != 4096
+#error "BITSET_BITS debe ser 64, 128, 256, 512 o 4096"
+#endif
+
+// Con 64 bits se conservan los buckets de 32 bits de la implementacion para
+// hardware, para conjuntos mas anchos se usan palabras de 64 bits
+#if BITSET_BITS == 64
+#define BUCKET_BITS 32
 typedef uint32_t bucket_t;
+#else
+#define BUCKET_BITS 64
+typedef uint64_t bucket_t;
+#endif
 
 // Debe poder representar todos los indices de bit dentro de un bucket_t
 typedef uint8_t bucket_bit_index_t;
@@ -35,11 +57,22 @@ typedef uint8_t bucket_bit_index_t;
 typedef uint8_t bucket_index_t;
 
 // Debe poder representar todos los indices de un bit dentro de bitset_t
+#if BITSET_BITS < 256
 typedef uint8_t bitset_element_index_t;
+#else
+typedef uint16_t bitset_element_index_t;
+#endif
 
 // Este valor ajusta el tamano del buffer interno de un bitset
 // MAX_BUCKETS debe poder ser representable con bucket_index_t
-#define MAX_BUCKETS 2
+#define MAX_BUCKETS (BITSET_BITS / BUCKET_BITS)
+
+// Si se define, se usan las instrucciones del procesador para buscar el
+// primer bit encendido. Los compiladores para hardware deben definir
+// BITSET_NO_BUILTINS
+#if defined(__GNUC__) && !defined(BITSET_NO_BUILTINS)
+#define BITSET_BUILTINS
+#endif
 
 // Conjunto de bits
 typedef struct _bitset_t
@@ -91,6 +124,9 @@ void bitset_intersect(bitset_t* ra, const bitset_t* b);
 // Comprueba si existe al menos un elemento en el conjunto
 bool bitset_any(const bitset_t* set);
 
+// Comprueba si dos conjuntos tienen los mismos elementos
+bool bitset_equals(const bitset_t* a, const bitset_t* b);
+
 // Obtiene el elemento apuntado por un iterador
 bitset_element_index_t bitset_element(const bitset_iterator_t i);
 
@@ -0,0 +1,467 @@
+// dfa.c
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene un compilador de NFA a DFA minimo guiado por tablas.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+#include "dfa.h"
+#include "alphabet.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef OIL_THREADS
+#include "workers.h"
+#define DFA_FETCH_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#else
+#define DFA_FETCH_ADD(p, v) ((*(p) += (v)) - (v))
+#endif
+
+// Indica que un conjunto no cabe en el limite de estados
+#define DFA_NO_STATE UINT32_MAX
+
+// Mezcla un valor en una dispersion
+uint64_t dfa_mix(uint64_t h, uint64_t v)
+{
+	return (h ^ v) * 0x9E3779B97F4A7C15ull;
+}
+
+// Dispersion de un conjunto de estados
+uint32_t dfa_set_hash(const bitset_t* set)
+{
+	uint64_t h = 1;
+	bucket_index_t i;
+	for (i = 0; i < MAX_BUCKETS; i++)
+	{
+		h = dfa_mix(h, set->buckets[i]);
+	}
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+// Conjuntos de estados del NFA encontrados durante la construccion, con una
+// tabla de dispersion para buscarlos. El estado s del DFA corresponde al
+// conjunto sets[s]
+typedef struct _dfa_builder_t
+{
+	bitset_t* sets;
+	uint32_t count;
+	uint32_t capacity;
+	// Cantidad maxima de estados permitida por el limite de memoria
+	uint32_t max_states;
+	// Filas de la tabla de transiciones, classes por estado
+	uint16_t classes;
+	dfa_state_t* next;
+	// Estado + 1 de cada posicion de la tabla de dispersion, 0 si esta libre
+	uint32_t* table;
+	uint32_t mask;
+} dfa_builder_t;
+
+// Agranda los arreglos del constructor al doble. Retorna false si no hay
+// memoria o si se supera el limite de estados
+bool dfa_builder_grow(dfa_builder_t* b)
+{
+	if (b->capacity >= b->max_states) return false;
+	uint32_t capacity = b->capacity == 0 ? 64 : b->capacity * 2;
+	if (capacity > b->max_states) capacity = b->max_states;
+
+	bitset_t* sets = (bitset_t*)realloc(b->sets, capacity * sizeof(bitset_t));
+	if (sets == NULL) return false;
+	b->sets = sets;
+	dfa_state_t* next = (dfa_state_t*)realloc(b->next,
+		(size_t)capacity * b->classes * sizeof(dfa_state_t));
+	if (next == NULL) return false;
+	b->next = next;
+
+	// la tabla de dispersion se mantiene a lo sumo medio llena
+	uint32_t size = 1;
+	while (size < 2 * capacity) size *= 2;
+	uint32_t* table = (uint32_t*)calloc(size, sizeof(uint32_t));
+	if (table == NULL) return false;
+	free(b->table);
+	b->table = table;
+	b->mask = size - 1;
+	b->capacity = capacity;
+	uint32_t s;
+	for (s = 0; s < b->count; s++)
+	{
+		uint32_t h = dfa_set_hash(&b->sets[s]) & b->mask;
+		while (b->table[h] != 0) h = (h + 1) & b->mask;
+		b->table[h] = s + 1;
+	}
+	return true;
+}
+
+// Busca el estado del conjunto, si no existe lo agrega. Retorna
+// DFA_NO_STATE si no hay memoria o si se supera el limite de estados
+uint32_t dfa_builder_find(dfa_builder_t* b, const bitset_t* set)
+{
+	uint32_t h = dfa_set_hash(set) & b->mask;
+	while (b->table[h] != 0)
+	{
+		uint32_t s = b->table[h] - 1;
+		if (bitset_equals(&b->sets[s], set)) return s;
+		h = (h + 1) & b->mask;
+	}
+	if (b->count == b->capacity)
+	{
+		if (!dfa_builder_grow(b)) return DFA_NO_STATE;
+		return dfa_builder_find(b, set);
+	}
+	uint32_t s = b->count++;
+	b->sets[s] = *set;
+	b->table[h] = s + 1;
+	return s;
+}
+
+// Libera los conjuntos y la tabla de dispersion del constructor
+void dfa_builder_free(dfa_builder_t* b)
+{
+	free(b->sets);
+	free(b->table);
+	b->sets = NULL;
+	b->table = NULL;
+}
+
+// Dispersion de la firma de un estado: su bloque y el de sus sucesores
+uint32_t dfa_block_hash(const uint32_t* block, const dfa_state_t* next,
+	uint16_t classes, uint32_t s)
+{
+	uint64_t h = dfa_mix(1, block[s]);
+	uint16_t c;
+	for (c = 0; c < classes; c++)
+	{
+		h = dfa_mix(h, block[next[(size_t)s * classes + c]]);
+	}
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+// Indica si dos estados tienen la misma firma
+bool dfa_block_equals(const uint32_t* block, const dfa_state_t* next,
+	uint16_t classes, uint32_t r, uint32_t s)
+{
+	if (block[r] != block[s]) return false;
+	uint16_t c;
+	for (c = 0; c < classes; c++)
+	{
+		if (block[next[(size_t)r * classes + c]] != block[next[(size_t)s * classes + c]])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Minimiza el DFA dado por next, final e initial (con count estados, todos
+// alcanzables) refinando la particion de estados finales y no finales
+// hasta que los estados de cada bloque tienen sucesores en los mismos
+// bloques (algoritmo de Moore). Cada ronda es lineal y hay a lo sumo tantas
+// rondas como estados, en la practica tantas como la profundidad del DFA
+bool dfa_minimize(dfa_t* dfa, const dfa_state_t* next, const bool* final,
+	uint32_t count, uint16_t classes, uint32_t initial)
+{
+	uint32_t* block = (uint32_t*)malloc(count * sizeof(uint32_t));
+	uint32_t* refined = (uint32_t*)malloc(count * sizeof(uint32_t));
+	uint32_t size = 1;
+	while (size < 2 * count) size *= 2;
+	uint32_t* table = (uint32_t*)malloc(size * sizeof(uint32_t));
+	bool ok = block != NULL && refined != NULL && table != NULL;
+
+	uint32_t blocks = 0;
+	if (ok)
+	{
+		// particion inicial, numerada en orden de aparicion
+		int32_t id[2] = { -1, -1 };
+		uint32_t s;
+		for (s = 0; s < count; s++)
+		{
+			if (id[final[s]] == -1) id[final[s]] = blocks++;
+			block[s] = id[final[s]];
+		}
+	}
+	while (ok)
+	{
+		memset(table, 0, size * sizeof(uint32_t));
+		uint32_t refined_blocks = 0;
+		uint32_t s;
+		for (s = 0; s < count; s++)
+		{
+			uint32_t h = dfa_block_hash(block, next, classes, s) & (size - 1);
+			while (table[h] != 0 &&
+				!dfa_block_equals(block, next, classes, table[h] - 1, s))
+			{
+				h = (h + 1) & (size - 1);
+			}
+			if (table[h] == 0)
+			{
+				table[h] = s + 1;
+				refined[s] = refined_blocks++;
+			}
+			else
+			{
+				refined[s] = refined[table[h] - 1];
+			}
+		}
+		// cada ronda solo divide bloques, si no aumentan la particion es estable
+		if (refined_blocks == blocks) break;
+		uint32_t* tmp = block;
+		block = refined;
+		refined = tmp;
+		blocks = refined_blocks;
+	}
+
+	if (ok)
+	{
+		dfa->next = (dfa_state_t*)malloc((size_t)blocks * classes * sizeof(dfa_state_t));
+		dfa->final = (bool*)malloc(blocks * sizeof(bool));
+		ok = dfa->next != NULL && dfa->final != NULL;
+	}
+	if (ok)
+	{
+		uint32_t s;
+		for (s = 0; s < count; s++)
+		{
+			uint32_t b = block[s];
+			uint16_t c;
+			for (c = 0; c < classes; c++)
+			{
+				dfa->next[(size_t)b * classes + c] =
+					block[next[(size_t)s * classes + c]] * classes;
+			}
+			dfa->final[b] = final[s];
+		}
+		dfa->states = blocks;
+		dfa->initial = block[initial] * classes;
+	}
+	free(block);
+	free(refined);
+	free(table);
+	return ok;
+}
+
+// Construye por subconjuntos el DFA equivalente al NFA y lo minimiza
+bool dfa_compile(dfa_t* dfa, const nfa_t* nfa, size_t max_bytes)
+{
+	memset(dfa, 0, sizeof(dfa_t));
+	dfa->symbols = nfa_get_symbols(nfa);
+	if (dfa->symbols == 0) return false;
+
+	alphabet_t alphabet;
+	alphabet_from_nfa(&alphabet, nfa);
+	memcpy(dfa->class_of, alphabet.class_of, sizeof(dfa->class_of));
+	const symbol_t* rep = alphabet.rep;
+	uint16_t classes = alphabet.classes;
+
+	// cada estado ocupa su fila, su conjunto y su parte de la tabla de
+	// dispersion; las filas premultiplicadas deben caber en dfa_state_t
+	size_t per_state = classes * sizeof(dfa_state_t) + sizeof(bitset_t) + 2 * sizeof(uint32_t);
+	size_t max_states = max_bytes / per_state;
+	if (max_states > (UINT32_MAX - 1) / classes) max_states = (UINT32_MAX - 1) / classes;
+
+	dfa_builder_t b;
+	memset(&b, 0, sizeof(b));
+	b.classes = classes;
+	b.max_states = (uint32_t)max_states;
+	bool ok = dfa_builder_grow(&b);
+
+	// el estado 0 es el conjunto vacio, del que no se sale
+	bitset_t set;
+	bitset_init(&set);
+	ok = ok && dfa_builder_find(&b, &set) != DFA_NO_STATE;
+	nfa_get_initials(nfa, &set);
+	uint32_t initial = ok ? dfa_builder_find(&b, &set) : DFA_NO_STATE;
+	ok = ok && initial != DFA_NO_STATE;
+
+	// los estados se agregan al final, se recorren en orden de anchura
+	uint32_t s;
+	for (s = 0; ok && s < b.count; s++)
+	{
+		bitset_t current = b.sets[s];
+		uint16_t c;
+		for (c = 0; ok && c < classes; c++)
+		{
+			nfa_step(nfa, &current, rep[c], &set);
+			uint32_t t = dfa_builder_find(&b, &set);
+			ok = t != DFA_NO_STATE;
+			b.next[(size_t)s * classes + c] = t;
+		}
+	}
+
+	bool* final = ok ? (bool*)malloc(b.count * sizeof(bool)) : NULL;
+	ok = ok && final != NULL;
+	if (ok)
+	{
+		bitset_t finals;
+		nfa_get_finals(nfa, &finals);
+		for (s = 0; s < b.count; s++)
+		{
+			set = b.sets[s];
+			bitset_intersect(&set, &finals);
+			final[s] = bitset_any(&set);
+		}
+	}
+	dfa_builder_free(&b);
+
+	if (ok)
+	{
+		dfa->classes = classes;
+		ok = dfa_minimize(dfa, b.next, final, b.count, classes, initial);
+	}
+	free(b.next);
+	free(final);
+	if (!ok) dfa_free(dfa);
+	return ok;
+}
+
+// Libera las tablas del DFA
+void dfa_free(dfa_t* dfa)
+{
+	free(dfa->next);
+	free(dfa->final);
+	dfa->next = NULL;
+	dfa->final = NULL;
+	dfa->states = 0;
+}
+
+// Bytes usados por las tablas del DFA
+size_t dfa_size(const dfa_t* dfa)
+{
+	return (size_t)dfa->states * (dfa->classes * sizeof(dfa_state_t) + sizeof(bool));
+}
+
+// Comprueba si el DFA reconoce la secuencia suministrada, con una lectura de
+// la tabla por simbolo
+bool dfa_accept_sample(const dfa_t* dfa, const symbol_t* sample, uint16_t length)
+{
+	const dfa_state_t* next = dfa->next;
+	const uint8_t* class_of = dfa->class_of;
+	dfa_state_t s = dfa->initial;
+	uint16_t i;
+	for (i = 0; i < length; i++)
+	{
+		s = next[s + class_of[sample[i]]];
+	}
+	return dfa->final[s / dfa->classes];
+}
+
+// Prepara el clasificador para el NFA
+bool dfa_classifier_init(dfa_classifier_t* classifier, const nfa_t* nfa, size_t max_bytes)
+{
+	classifier->nfa = nfa;
+	classifier->compiled = dfa_compile(&classifier->dfa, nfa, max_bytes);
+	return classifier->compiled;
+}
+
+// Libera el clasificador
+void dfa_classifier_free(dfa_classifier_t* classifier)
+{
+	dfa_free(&classifier->dfa);
+	classifier->compiled = false;
+}
+
+// Comprueba si el automata reconoce la secuencia suministrada
+bool dfa_classifier_accept(const dfa_classifier_t* classifier,
+	const symbol_t* sample, uint16_t length)
+{
+	if (classifier->compiled)
+	{
+		return dfa_accept_sample(&classifier->dfa, sample, length);
+	}
+	return nfa_accept_sample(classifier->nfa, sample, length);
+}
+
+// Entradas de dfa_classify repartidas entre los hilos
+typedef struct _dfa_classify_task_t
+{
+	const dfa_classifier_t* classifier;
+	const symbol_t* const* inputs;
+	const uint16_t* lengths;
+	size_t count;
+	uint64_t* results;
+	// Primera entrada del siguiente bloque
+	size_t next;
+} dfa_classify_task_t;
+
+// Tarea de cada hilo: toma bloques de DFA_CLASSIFY_CHUNK entradas hasta
+// agotarlas
+void dfa_classify_worker(void* ctx, int worker)
+{
+	(void)worker;
+	dfa_classify_task_t* task = (dfa_classify_task_t*)ctx;
+	const dfa_classifier_t* classifier = task->classifier;
+
+	// sin DFA, la cache de pasos es mas rapida que simular cada entrada;
+	// si no hay memoria se simula sin cache
+	nfa_cache_t* cache = NULL;
+	if (!classifier->compiled)
+	{
+		cache = (nfa_cache_t*)malloc(sizeof(nfa_cache_t));
+		if (cache != NULL) nfa_cache_init(cache);
+	}
+
+	for (;;)
+	{
+		size_t begin = DFA_FETCH_ADD(&task->next, DFA_CLASSIFY_CHUNK);
+		if (begin >= task->count) break;
+		size_t end = begin + DFA_CLASSIFY_CHUNK < task->count ?
+			begin + DFA_CLASSIFY_CHUNK : task->count;
+		size_t k;
+		for (k = begin; k < end; k += 64)
+		{
+			uint64_t word = 0;
+			size_t lanes = end - k < 64 ? end - k : 64;
+			size_t l;
+			for (l = 0; l < lanes; l++)
+			{
+				const symbol_t* input = task->inputs[k + l];
+				uint16_t length = task->lengths[k + l];
+				bool r;
+				if (classifier->compiled)
+				{
+					r = dfa_accept_sample(&classifier->dfa, input, length);
+				}
+				else if (cache != NULL)
+				{
+					r = nfa_accept_sample_cached(classifier->nfa, cache, input, length);
+				}
+				else
+				{
+					r = nfa_accept_sample(classifier->nfa, input, length);
+				}
+				word |= (uint64_t)r << l;
+			}
+			task->results[k / 64] = word;
+		}
+	}
+	free(cache);
+}
+
+// Clasifica count entradas repartiendolas entre los hilos de workers
+void dfa_classify(const dfa_classifier_t* classifier,
+	const symbol_t* const* inputs, const uint16_t* lengths, size_t count,
+	uint64_t* results, struct _workers_t* workers)
+{
+	dfa_classify_task_t task;
+	task.classifier = classifier;
+	task.inputs = inputs;
+	task.lengths = lengths;
+	task.count = count;
+	task.results = results;
+	task.next = 0;
+
+	// con un solo bloque no vale la pena despertar a los hilos
+#ifdef OIL_THREADS
+	if (workers != NULL && workers->count > 1 && count > DFA_CLASSIFY_CHUNK)
+	{
+		workers_run(workers, dfa_classify_worker, &task);
+		return;
+	}
+#else
+	(void)workers;
+#endif
+	dfa_classify_worker(&task, 0);
+}
@@ -0,0 +1,107 @@
+// dfa.h
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene un compilador de NFA a DFA minimo guiado por tablas,
+// para clasificar grandes volumenes de muestras con el automata aprendido.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+//------------------------------------------------------------------------------
+#pragma once
+#include "nfa.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Limite por defecto de bytes de la tabla de transiciones del DFA
+#ifndef DFA_MAX_BYTES
+#define DFA_MAX_BYTES (64u << 20)
+#endif
+
+// Estado del DFA. En la tabla cada estado se representa por la posicion de
+// su fila, es decir estado * clases, de manera que un paso de simulacion es
+// una suma y una lectura
+typedef uint32_t dfa_state_t;
+
+// DFA minimo guiado por tablas. Los simbolos con las mismas transiciones en
+// el NFA forman una clase, y la tabla tiene una fila por estado con una
+// columna por clase
+typedef struct _dfa_t
+{
+	// Cantidad de estados y de clases de simbolos
+	uint32_t states;
+	uint16_t classes;
+	// Simbolos del alfabeto del NFA
+	symbol_t symbols;
+	// Fila del estado inicial
+	dfa_state_t initial;
+	// Clase de cada simbolo
+	uint8_t class_of[256];
+	// next[fila + clase] es la fila del estado siguiente
+	dfa_state_t* next;
+	// final[estado] indica si el estado es de aceptacion
+	bool* final;
+} dfa_t;
+
+// Construye por subconjuntos el DFA equivalente al NFA y lo minimiza.
+// max_bytes limita la memoria de la construccion, que por cada estado
+// guarda su fila de la tabla y su conjunto de estados del NFA. Retorna
+// false si no hay memoria o si se supera el limite; en tal caso dfa queda
+// vacio
+bool dfa_compile(dfa_t* dfa, const nfa_t* nfa, size_t max_bytes);
+
+// Libera las tablas del DFA
+void dfa_free(dfa_t* dfa);
+
+// Bytes usados por las tablas del DFA
+size_t dfa_size(const dfa_t* dfa);
+
+// Comprueba si el DFA reconoce la secuencia suministrada. Los simbolos deben
+// pertenecer al alfabeto del NFA compilado
+bool dfa_accept_sample(const dfa_t* dfa, const symbol_t* sample, uint16_t length);
+
+// Clasificador que usa el DFA compilado o, si este supera el limite de
+// tamano, el NFA original
+typedef struct _dfa_classifier_t
+{
+	const nfa_t* nfa;
+	dfa_t dfa;
+	bool compiled;
+} dfa_classifier_t;
+
+// Prepara el clasificador para el NFA, que debe permanecer sin cambios
+// mientras se use. Retorna true si se pudo compilar el DFA
+bool dfa_classifier_init(dfa_classifier_t* classifier, const nfa_t* nfa, size_t max_bytes);
+
+// Libera el clasificador
+void dfa_classifier_free(dfa_classifier_t* classifier);
+
+// Comprueba si el automata reconoce la secuencia suministrada
+bool dfa_classifier_accept(const dfa_classifier_t* classifier,
+	const symbol_t* sample, uint16_t length);
+
+// Cantidad de entradas que toma cada hilo a la vez en dfa_classify. Debe
+// ser multiplo de 64 para que cada hilo escriba palabras completas
+#ifndef DFA_CLASSIFY_CHUNK
+#define DFA_CLASSIFY_CHUNK 1024u
+#endif
+
+struct _workers_t;
+
+// Clasifica count entradas de cualquier longitud: la entrada k inicia en
+// inputs[k] y mide lengths[k] simbolos. El bit k % 64 de results[k / 64]
+// queda encendido si el automata la reconoce; results debe tener
+// (count + 63) / 64 palabras. Las entradas se reparten por bloques entre
+// los hilos de workers (solo si se compila con OIL_THREADS), que el llamador
+// crea con workers_init y puede usar en varias llamadas; con NULL el hilo
+// actual clasifica todo. Sin DFA compilado cada hilo simula el NFA con su
+// propia cache de pasos
+void dfa_classify(const dfa_classifier_t* classifier,
+	const symbol_t* const* inputs, const uint16_t* lengths, size_t count,
+	uint64_t* results, struct _workers_t* workers);
@@ -0,0 +1,383 @@
+// model.c
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene un formato binario versionado para guardar los
+// automatas aprendidos y cargarlos con mmap sin copiarlos.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+#include "model.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Redondea al siguiente multiplo de 8
+uint64_t model_align(uint64_t n)
+{
+	return (n + 7) & ~(uint64_t)7;
+}
+
+// Posicion de cada seccion dentro del archivo
+typedef struct _model_layout_t
+{
+	uint64_t initials;
+	uint64_t finals;
+	uint64_t row;
+	uint64_t edge;
+	uint64_t class_of;
+	uint64_t next;
+	uint64_t final;
+	uint64_t size;
+} model_layout_t;
+
+// Calcula la posicion de las secciones a partir de las cantidades del
+// encabezado
+void model_layout(const model_header_t* h, model_layout_t* l)
+{
+	uint64_t bitmap = ((uint64_t)h->states + 7) / 8;
+	l->initials = model_align(sizeof(model_header_t));
+	l->finals = model_align(l->initials + bitmap);
+	l->row = model_align(l->finals + bitmap);
+	l->edge = model_align(l->row + ((uint64_t)h->states + 1) * sizeof(uint32_t));
+	l->class_of = model_align(l->edge + (uint64_t)h->edges * sizeof(uint32_t));
+	l->next = l->class_of;
+	l->final = l->class_of;
+	l->size = l->class_of;
+	if (h->classes > 0)
+	{
+		l->next = model_align(l->class_of + 256);
+		l->final = model_align(l->next +
+			(uint64_t)h->dfa_states * h->classes * sizeof(dfa_state_t));
+		l->size = model_align(l->final + h->dfa_states);
+	}
+}
+
+// Escribe count bytes y completa con ceros hasta la posicion end
+bool model_write(FILE* out, const void* data, uint64_t count, uint64_t* pos, uint64_t end)
+{
+	static const uint8_t zeros[8];
+	if (count > 0 && fwrite(data, 1, count, out) != count) return false;
+	*pos += count;
+	while (*pos < end)
+	{
+		uint64_t n = end - *pos < 8 ? end - *pos : 8;
+		if (fwrite(zeros, 1, n, out) != n) return false;
+		*pos += n;
+	}
+	return true;
+}
+
+// Escribe el modelo en out y lo cierra. Retorna false si out es NULL o no se
+// pudo escribir
+bool model_save_stream(FILE* out, const nfa_t* nfa, const dfa_t* dfa)
+{
+	symbol_t symbols = nfa_get_symbols(nfa);
+
+	// estados vivos, renumerados en orden, y cantidad de transiciones
+	uint32_t id[MAX_STATES];
+	uint32_t states = 0;
+	uint32_t edges = 0;
+	bitset_t succ;
+	state_t q;
+	for (q = 0; q < MAX_STATES; q++)
+	{
+		bool live = nfa_is_initial(nfa, q) || nfa_is_final(nfa, q);
+		symbol_t a;
+		for (a = 0; a < symbols; a++)
+		{
+			bitset_t pred;
+			nfa_get_sucessors(nfa, q, a, &succ);
+			nfa_get_predecessors(nfa, q, a, &pred);
+			live = live || bitset_any(&succ) || bitset_any(&pred);
+			bitset_iterator_t j;
+			for (j = bitset_first(&succ); !bitset_end(j); j = bitset_next(&succ, j))
+			{
+				edges++;
+			}
+		}
+		id[q] = live ? states++ : UINT32_MAX;
+	}
+
+	model_header_t h;
+	memset(&h, 0, sizeof(h));
+	h.magic = MODEL_MAGIC;
+	h.version = MODEL_VERSION;
+	h.header_size = sizeof(model_header_t);
+	h.states = states;
+	h.symbols = symbols;
+	if (dfa != NULL)
+	{
+		h.classes = dfa->classes;
+		h.dfa_states = dfa->states;
+		h.dfa_initial = dfa->initial;
+	}
+
+	uint8_t* initials = (uint8_t*)calloc((states + 7) / 8 + 1, 1);
+	uint8_t* finals = (uint8_t*)calloc((states + 7) / 8 + 1, 1);
+	uint32_t* row = (uint32_t*)malloc((states + 1) * sizeof(uint32_t));
+	uint32_t* edge = (uint32_t*)malloc((edges + 1) * sizeof(uint32_t));
+	bool ok = initials != NULL && finals != NULL && row != NULL && edge != NULL;
+	edges = 0;
+	for (q = 0; ok && q < MAX_STATES; q++)
+	{
+		uint32_t s = id[q];
+		if (s == UINT32_MAX) continue;
+		if (nfa_is_initial(nfa, q)) initials[s / 8] |= 1u << (s % 8);
+		if (nfa_is_final(nfa, q)) finals[s / 8] |= 1u << (s % 8);
+		row[s] = edges;
+		symbol_t a;
+		for (a = 0; a < symbols; a++)
+		{
+			nfa_get_sucessors(nfa, q, a, &succ);
+			bitset_iterator_t j;
+			for (j = bitset_first(&succ); !bitset_end(j); j = bitset_next(&succ, j))
+			{
+				edge[edges++] = id[bitset_element(j)] << 8 | a;
+			}
+		}
+	}
+	if (ok) row[states] = edges;
+	h.edges = edges;
+
+	model_layout_t l;
+	model_layout(&h, &l);
+	h.size = l.size;
+
+	ok = ok && out != NULL;
+	uint64_t pos = 0;
+	ok = ok && model_write(out, &h, sizeof(h), &pos, l.initials);
+	ok = ok && model_write(out, initials, (states + 7) / 8, &pos, l.finals);
+	ok = ok && model_write(out, finals, (states + 7) / 8, &pos, l.row);
+	ok = ok && model_write(out, row, (states + 1) * sizeof(uint32_t), &pos, l.edge);
+	ok = ok && model_write(out, edge, edges * sizeof(uint32_t), &pos, l.class_of);
+	if (dfa != NULL)
+	{
+		ok = ok && model_write(out, dfa->class_of, 256, &pos, l.next);
+		ok = ok && model_write(out, dfa->next,
+			(uint64_t)dfa->states * dfa->classes * sizeof(dfa_state_t), &pos, l.final);
+		ok = ok && model_write(out, dfa->final, dfa->states, &pos, l.size);
+	}
+	if (out != NULL && fclose(out) != 0) ok = false;
+
+	free(initials);
+	free(finals);
+	free(row);
+	free(edge);
+	return ok;
+}
+
+// Guarda el NFA, y el DFA compilado si dfa no es NULL, en path
+bool model_save(const char* path, const nfa_t* nfa, const dfa_t* dfa)
+{
+	return model_save_stream(fopen(path, "wb"), nfa, dfa);
+}
+
+// Igual que model_save, pero en memoria reservada con malloc
+bool model_save_buffer(void** data, size_t* size, const nfa_t* nfa, const dfa_t* dfa)
+{
+	char* buffer = NULL;
+	size_t length = 0;
+	bool ok = model_save_stream(open_memstream(&buffer, &length), nfa, dfa);
+	if (!ok)
+	{
+		free(buffer);
+		buffer = NULL;
+		length = 0;
+	}
+	*data = buffer;
+	*size = length;
+	return ok;
+}
+
+// Prepara el modelo sobre size bytes que contienen un archivo completo
+bool model_map(model_t* model, const void* data, size_t size)
+{
+	memset(model, 0, sizeof(model_t));
+	const uint8_t* base = (const uint8_t*)data;
+	const model_header_t* h = (const model_header_t*)data;
+	if (((uintptr_t)data & 7) != 0 || size < sizeof(model_header_t)) return false;
+	if (h->magic != MODEL_MAGIC || h->version != MODEL_VERSION ||
+		h->header_size != sizeof(model_header_t) || h->size != size)
+	{
+		return false;
+	}
+	if (h->symbols == 0 || h->classes > h->symbols) return false;
+
+	model_layout_t l;
+	model_layout(h, &l);
+	if (l.size != size) return false;
+
+	const uint32_t* row = (const uint32_t*)(base + l.row);
+	const uint32_t* edge = (const uint32_t*)(base + l.edge);
+
+	// las posiciones y destinos deben quedar dentro de las tablas, para que
+	// un archivo danado no provoque lecturas fuera de la region
+	uint32_t q;
+	if (row[0] != 0 || row[h->states] != h->edges) return false;
+	for (q = 0; q < h->states; q++)
+	{
+		if (row[q] > row[q + 1]) return false;
+	}
+	uint32_t e;
+	for (e = 0; e < h->edges; e++)
+	{
+		if ((edge[e] >> 8) >= h->states || (edge[e] & 0xFF) >= h->symbols) return false;
+	}
+
+	model->header = h;
+	model->initials = base + l.initials;
+	model->finals = base + l.finals;
+	model->row = row;
+	model->edge = edge;
+	if (h->classes > 0)
+	{
+		const uint8_t* class_of = base + l.class_of;
+		const dfa_state_t* next = (const dfa_state_t*)(base + l.next);
+		uint64_t cells = (uint64_t)h->dfa_states * h->classes;
+		uint32_t a;
+		for (a = 0; a < h->symbols; a++)
+		{
+			if (class_of[a] >= h->classes) return false;
+		}
+		uint64_t i;
+		for (i = 0; i < cells; i++)
+		{
+			if (next[i] >= cells || next[i] % h->classes != 0) return false;
+		}
+		if (h->dfa_initial >= cells || h->dfa_initial % h->classes != 0) return false;
+		const uint8_t* final = base + l.final;
+		for (i = 0; i < h->dfa_states; i++)
+		{
+			if (final[i] > 1) return false;
+		}
+
+		// el DFA apunta a las tablas del archivo, nunca se debe liberar
+		model->has_dfa = true;
+		model->dfa.states = h->dfa_states;
+		model->dfa.classes = h->classes;
+		model->dfa.symbols = (symbol_t)h->symbols;
+		model->dfa.initial = h->dfa_initial;
+		memcpy(model->dfa.class_of, class_of, 256);
+		model->dfa.next = (dfa_state_t*)next;
+		model->dfa.final = (bool*)(base + l.final);
+	}
+	return true;
+}
+
+// Abre el archivo con mmap de solo lectura
+bool model_open(model_t* model, const char* path)
+{
+	memset(model, 0, sizeof(model_t));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	void* data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (data == MAP_FAILED) return false;
+	if (!model_map(model, data, st.st_size))
+	{
+		munmap(data, st.st_size);
+		return false;
+	}
+	model->mapping = data;
+	model->mapping_size = st.st_size;
+	return true;
+}
+
+// Libera la region mapeada por model_open
+void model_close(model_t* model)
+{
+	if (model->mapping != NULL) munmap(model->mapping, model->mapping_size);
+	memset(model, 0, sizeof(model_t));
+}
+
+// Indica si el bit q del mapa de bits esta encendido
+bool model_bit(const uint8_t* bitmap, uint32_t q)
+{
+	return (bitmap[q / 8] >> (q % 8)) & 1;
+}
+
+// Comprueba si el modelo reconoce la secuencia suministrada
+bool model_accept_sample(const model_t* model, const symbol_t* sample, uint16_t length)
+{
+	if (model->has_dfa) return dfa_accept_sample(&model->dfa, sample, length);
+
+	// simulacion del NFA sobre las tablas del archivo, un bit por estado
+	uint32_t states = model->header->states;
+	size_t words = (states + 63) / 64;
+	uint64_t stack[2][8];
+	uint64_t* current = words <= 8 ? stack[0] : (uint64_t*)calloc(words, sizeof(uint64_t));
+	uint64_t* next = words <= 8 ? stack[1] : (uint64_t*)calloc(words, sizeof(uint64_t));
+	bool accepted = false;
+	if (current != NULL && next != NULL)
+	{
+		uint32_t q;
+		memset(current, 0, words * sizeof(uint64_t));
+		for (q = 0; q < states; q++)
+		{
+			if (model_bit(model->initials, q)) current[q / 64] |= (uint64_t)1 << (q % 64);
+		}
+		uint16_t i;
+		for (i = 0; i < length; i++)
+		{
+			memset(next, 0, words * sizeof(uint64_t));
+			for (q = 0; q < states; q++)
+			{
+				if (!((current[q / 64] >> (q % 64)) & 1)) continue;
+				uint32_t e;
+				for (e = model->row[q]; e < model->row[q + 1]; e++)
+				{
+					if ((model->edge[e] & 0xFF) != sample[i]) continue;
+					uint32_t t = model->edge[e] >> 8;
+					next[t / 64] |= (uint64_t)1 << (t % 64);
+				}
+			}
+			uint64_t* tmp = current;
+			current = next;
+			next = tmp;
+		}
+		for (q = 0; q < states && !accepted; q++)
+		{
+			accepted = ((current[q / 64] >> (q % 64)) & 1) && model_bit(model->finals, q);
+		}
+	}
+	if (words > 8)
+	{
+		free(current);
+		free(next);
+	}
+	return accepted;
+}
+
+// Reconstruye el NFA del modelo
+bool model_to_nfa(const model_t* model, nfa_t* nfa)
+{
+	const model_header_t* h = model->header;
+	if (h->states > MAX_STATES || h->symbols > MAX_SYMBOLS) return false;
+	nfa_init(nfa, (symbol_t)h->symbols);
+	uint32_t q;
+	for (q = 0; q < h->states; q++)
+	{
+		if (model_bit(model->initials, q)) nfa_add_initial(nfa, q);
+		if (model_bit(model->finals, q)) nfa_add_final(nfa, q);
+		uint32_t e;
+		for (e = model->row[q]; e < model->row[q + 1]; e++)
+		{
+			if (!nfa_add_transition(nfa, q, model->edge[e] >> 8, model->edge[e] & 0xFF)) return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,101 @@
+// model.h
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene un formato binario versionado para guardar los
+// automatas aprendidos y cargarlos con mmap sin copiarlos.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+//------------------------------------------------------------------------------
+#pragma once
+#include "nfa.h"
+#include "dfa.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// "OILM" leido como entero en el orden de bytes de la maquina. Un archivo
+// escrito en una maquina con otro orden de bytes no se reconoce
+#define MODEL_MAGIC 0x4D4C494Fu
+
+// Version del formato, se incrementa con cada cambio incompatible
+#define MODEL_VERSION 1u
+
+// Encabezado del archivo. Le siguen las secciones, cada una alineada a 8
+// bytes y en este orden:
+// - initials, finals: mapas de bits de states bits
+// - row: states + 1 posiciones, las transiciones del estado q son
+//   edge[row[q]..row[q+1]), ordenadas por simbolo
+// - edge: edges transiciones, cada una como (destino << 8) | simbolo
+// - si classes > 0, el DFA compilado: class_of (256 bytes), next
+//   (dfa_states * classes filas premultiplicadas) y final (dfa_states bytes)
+// Solo se guardan los estados vivos (con transiciones, iniciales o finales),
+// renumerados en orden
+typedef struct _model_header_t
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;
+	uint32_t states;
+	uint32_t edges;
+	uint16_t symbols;
+	uint16_t classes;
+	uint32_t dfa_states;
+	uint32_t dfa_initial;
+	uint32_t reserved;
+	// Tamano total del archivo en bytes
+	uint64_t size;
+} model_header_t;
+
+// Modelo de solo lectura. Las tablas apuntan directamente a los bytes del
+// archivo, que se pueden compartir entre procesos
+typedef struct _model_t
+{
+	const model_header_t* header;
+	const uint8_t* initials;
+	const uint8_t* finals;
+	const uint32_t* row;
+	const uint32_t* edge;
+	// DFA compilado sobre las tablas del archivo, solo si has_dfa
+	bool has_dfa;
+	dfa_t dfa;
+	// Region mapeada por model_open, NULL si la memoria es del llamador
+	void* mapping;
+	size_t mapping_size;
+} model_t;
+
+// Guarda el NFA, y el DFA compilado si dfa no es NULL, en path. Retorna
+// false si no se pudo escribir el archivo
+bool model_save(const char* path, const nfa_t* nfa, const dfa_t* dfa);
+
+// Igual que model_save, pero escribe el archivo en memoria reservada con
+// malloc: *data recibe los bytes, alineados a 8, y *size su cantidad. Se
+// carga con model_map y se libera con free. Retorna false si no hay memoria
+bool model_save_buffer(void** data, size_t* size, const nfa_t* nfa, const dfa_t* dfa);
+
+// Prepara el modelo sobre size bytes que contienen un archivo completo, sin
+// copiarlos. Los bytes deben estar alineados a 8 y permanecer sin cambios
+// mientras se use el modelo. Retorna false si el contenido no es valido
+bool model_map(model_t* model, const void* data, size_t size);
+
+// Abre el archivo con mmap de solo lectura. Retorna false si no se puede
+// abrir o no es valido
+bool model_open(model_t* model, const char* path);
+
+// Libera la region mapeada por model_open
+void model_close(model_t* model);
+
+// Comprueba si el modelo reconoce la secuencia suministrada. Usa el DFA si
+// el archivo lo incluye, de lo contrario simula el NFA
+bool model_accept_sample(const model_t* model, const symbol_t* sample, uint16_t length);
+
+// Reconstruye el NFA del modelo. nfa se inicializa como con nfa_init.
+// Retorna false si no cabe en MAX_STATES estados, MAX_SYMBOLS simbolos o
+// el espacio para las transiciones
+bool model_to_nfa(const model_t* model, nfa_t* nfa);
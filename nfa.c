@@ -16,6 +16,21 @@
 #include "nfa.h"
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#ifdef OIL_THREADS
+#define NFA_FETCH_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#else
+#define NFA_FETCH_ADD(p, v) ((*(p) += (v)) - (v))
+#endif
+
+// Los nucleos vectoriales de nfa_step solo se compilan con GCC para x86-64,
+// con filas de al menos 256 bits. BITSET_NO_BUILTINS (compiladores para
+// hardware) los excluye junto con la seleccion por procesador
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(BITSET_NO_BUILTINS) && \
+	BITSET_BITS >= 256
+#define NFA_STEP_SIMD
+#include <immintrin.h>
+#endif
 
 void _conformance_check_nfa(void)
 {
@@ -32,11 +47,23 @@ state_t nfa_get_states(const nfa_t* nfa)
 	return MAX_STATES;
 }
 
+// Bloques de versiones ya entregados por nfa_new_version
+uint64_t nfa_versions = 0;
+
+// Primera version de un automata recien inicializado o copiado. Cada
+// automata recibe su propio bloque de 2^32 versiones, asi que no repite
+// una version que tuvo antes de inicializarse de nuevo
+uint64_t nfa_new_version(void)
+{
+	return (NFA_FETCH_ADD(&nfa_versions, 1) + 1) << 32;
+}
+
 void nfa_add_initial(nfa_t* nfa, state_t q)
 {
 	assert(q < nfa_get_states(nfa));
 
 	bitset_add(&nfa->initials, q);
+	nfa->version++;
 }
 
 void nfa_remove_initial(nfa_t* nfa, state_t q)
@@ -44,6 +71,7 @@ void nfa_remove_initial(nfa_t* nfa, state_t q)
 	assert(q < nfa_get_states(nfa));
 
 	bitset_remove(&nfa->initials, q);
+	nfa->version++;
 }
 
 bool nfa_is_initial(const nfa_t* nfa, state_t q)
@@ -63,6 +91,7 @@ void nfa_add_final(nfa_t* nfa, state_t q)
 	assert(q < nfa_get_states(nfa));
 
 	bitset_add(&nfa->finals, q);
+	nfa->version++;
 }
 
 void nfa_remove_final(nfa_t* nfa, state_t q)
@@ -70,6 +99,7 @@ void nfa_remove_final(nfa_t* nfa, state_t q)
 	assert(q < nfa_get_states(nfa));
 
 	bitset_remove(&nfa->finals, q);
+	nfa->version++;
 }
 
 bool nfa_is_final(const nfa_t* nfa, state_t q)
@@ -90,14 +120,128 @@ symbol_t nfa_get_symbols(const nfa_t* nfa)
 	return nfa->symbols;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// REPRESENTACION DISPERSA
+
+// Inicializa las listas de adyacencia sin transiciones
+void nfa_adjacency_init(nfa_adjacency_t* adj)
+{
+	state_t q;
+	for (q = 0; q < MAX_STATES; q++)
+	{
+		adj->out[q] = NO_EDGE;
+		adj->in[q] = NO_EDGE;
+	}
+	adj->free = NO_EDGE;
+	adj->used = 0;
+	adj->edges = 0;
+}
+
+// Busca la transicion q0 -> q1 (usando el simbolo a) en la lista de salida
+// de q0. Retorna NO_EDGE si no existe
+edge_index_t nfa_adjacency_find(const nfa_adjacency_t* adj,
+	state_t q0,
+	state_t q1,
+	symbol_t a)
+{
+	edge_index_t e;
+	for (e = adj->out[q0]; e != NO_EDGE; e = adj->edge[e].next_out)
+	{
+		if (adj->edge[e].a == a && adj->edge[e].q1 == q1) return e;
+	}
+	return NO_EDGE;
+}
+
+// Agrega la transicion q0 -> q1 si no existe. Retorna false si no queda
+// espacio para agregarla
+bool nfa_adjacency_add(nfa_adjacency_t* adj,
+	state_t q0,
+	state_t q1,
+	symbol_t a)
+{
+	if (nfa_adjacency_find(adj, q0, q1, a) != NO_EDGE) return true;
+
+	edge_index_t e;
+	if (adj->free != NO_EDGE)
+	{
+		e = adj->free;
+		adj->free = adj->edge[e].next_out;
+	}
+	else if (adj->used < MAX_SPARSE_EDGES)
+	{
+		e = adj->used++;
+	}
+	else
+	{
+		return false;
+	}
+	nfa_edge_t* edge = &adj->edge[e];
+	edge->q0 = q0;
+	edge->q1 = q1;
+	edge->a = a;
+	edge->next_out = adj->out[q0];
+	edge->next_in = adj->in[q1];
+	adj->out[q0] = e;
+	adj->in[q1] = e;
+	adj->edges++;
+	return true;
+}
+
+// Elimina la transicion q0 -> q1 si existe
+void nfa_adjacency_remove(nfa_adjacency_t* adj,
+	state_t q0,
+	state_t q1,
+	symbol_t a)
+{
+	edge_index_t e;
+	edge_index_t* link;
+	for (link = &adj->out[q0]; *link != NO_EDGE; link = &adj->edge[*link].next_out)
+	{
+		if (adj->edge[*link].a == a && adj->edge[*link].q1 == q1) break;
+	}
+	e = *link;
+	if (e == NO_EDGE) return;
+	*link = adj->edge[e].next_out;
+
+	for (link = &adj->in[q1]; *link != e; link = &adj->edge[*link].next_in);
+	*link = adj->edge[e].next_in;
+
+	adj->edge[e].next_out = adj->free;
+	adj->free = e;
+	adj->edges--;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// NFA
+
+// Posicion en las tablas densas de la fila del par estado-simbolo
+size_t nfa_row(const nfa_t* nfa, state_t state, symbol_t sym)
+{
+	return nfa->symbol_major ? (size_t)sym * MAX_STATES + state :
+		(size_t)state * nfa->symbols + sym;
+}
+
 // Obtiene el conjunto de sucesores de un par estado-simbolo de un automata
 void nfa_get_sucessors(const nfa_t* nfa, state_t state, symbol_t sym, bitset_t* bs)
 {
 	assert(state < nfa_get_states(nfa));
 	assert(sym < nfa_get_symbols(nfa));
 
-	size_t offset = (state * nfa_get_symbols(nfa) + sym);
+	if (nfa->sparse)
+	{
+		const nfa_adjacency_t* adj = &nfa->adjacency;
+		bitset_init(bs);
+		edge_index_t e;
+		for (e = adj->out[state]; e != NO_EDGE; e = adj->edge[e].next_out)
+		{
+			if (adj->edge[e].a == sym) bitset_add(bs, adj->edge[e].q1);
+		}
+		return;
+	}
+#ifndef NFA_NO_DENSE
+	size_t offset = nfa_row(nfa, state, sym);
 	*bs = nfa->forward[offset];
+#endif
 }
 
 // Obtiene el conjunto de predecesores de un par estado-simbolo de un automata
@@ -106,11 +250,93 @@ void nfa_get_predecessors(const nfa_t* nfa, state_t state, symbol_t sym, bitset_
 	assert(state < nfa_get_states(nfa));
 	assert(sym < nfa_get_symbols(nfa));
 
-	size_t offset = (state * nfa_get_symbols(nfa) + sym);
+	if (nfa->sparse)
+	{
+		const nfa_adjacency_t* adj = &nfa->adjacency;
+		bitset_init(bs);
+		edge_index_t e;
+		for (e = adj->in[state]; e != NO_EDGE; e = adj->edge[e].next_in)
+		{
+			if (adj->edge[e].a == sym) bitset_add(bs, adj->edge[e].q0);
+		}
+		return;
+	}
+#ifndef NFA_NO_DENSE
+	size_t offset = nfa_row(nfa, state, sym);
 	*bs = nfa->backward[offset];
+#endif
+}
+
+#ifndef NFA_NO_DENSE
+#ifdef NFA_HEAP_DENSE
+// Reserva tablas densas de symbols * MAX_STATES filas si las actuales no
+// alcanzan. Las filas quedan sin inicializar. Retorna false si no hay memoria
+bool nfa_dense_reserve(nfa_t* nfa)
+{
+	size_t rows = (size_t)nfa->symbols * MAX_STATES;
+	if (nfa->forward != NULL && nfa->dense_rows >= rows) return true;
+	bitset_t* forward = (bitset_t*)malloc(rows * sizeof(bitset_t));
+	bitset_t* backward = (bitset_t*)malloc(rows * sizeof(bitset_t));
+	if (forward == NULL || backward == NULL)
+	{
+		free(forward);
+		free(backward);
+		return false;
+	}
+	free(nfa->forward);
+	free(nfa->backward);
+	nfa->forward = forward;
+	nfa->backward = backward;
+	nfa->dense_rows = rows;
+	return true;
+}
+
+// Libera las tablas densas
+void nfa_dense_free(nfa_t* nfa)
+{
+	free(nfa->forward);
+	free(nfa->backward);
+	nfa->forward = NULL;
+	nfa->backward = NULL;
+	nfa->dense_rows = 0;
+}
+#else
+// Las tablas son parte de nfa_t y siempre alcanzan
+bool nfa_dense_reserve(nfa_t* nfa)
+{
+	(void)nfa;
+	return true;
+}
+
+void nfa_dense_free(nfa_t* nfa)
+{
+	(void)nfa;
+}
+#endif
+
+// Inicializa las tablas densas sin transiciones
+void nfa_dense_init(nfa_t* nfa)
+{
+	size_t i;
+	for (i = 0; i < nfa->symbols*MAX_STATES; i++)
+	{
+		bitset_init(&nfa->forward[i]);
+		bitset_init(&nfa->backward[i]);
+	}
+}
+
+// Indica si conviene pasar a las tablas densas con las transiciones
+// actuales, segun NFA_DENSE_RATIO
+bool nfa_dense_pays_off(const nfa_t* nfa)
+{
+	uint64_t lists = (uint64_t)nfa->adjacency.edges * sizeof(nfa_edge_t);
+	uint64_t tables = 2 * (uint64_t)nfa->symbols * MAX_STATES * sizeof(bitset_t);
+	return lists * NFA_DENSE_RATIO >= tables;
 }
+#endif
 
-// Inicializa un NFA de manera que queda sin estados ni transiciones
+// Inicializa un NFA de manera que queda sin estados ni transiciones, en la
+// representacion dispersa
 void nfa_init(nfa_t* nfa, symbol_t symbols)
 {
 	assert(symbols <= MAX_SYMBOLS);
@@ -118,19 +344,155 @@ void nfa_init(nfa_t* nfa, symbol_t symbols)
 	bitset_init(&nfa->initials);
 	bitset_init(&nfa->finals);
 	nfa->symbols = symbols;
+	nfa->symbol_major = false;
+	nfa->sparse = true;
+	nfa->version = nfa_new_version();
+	nfa_adjacency_init(&nfa->adjacency);
+#if defined(NFA_HEAP_DENSE) && !defined(NFA_NO_DENSE)
+	nfa->forward = NULL;
+	nfa->backward = NULL;
+	nfa->dense_rows = 0;
+#endif
+}
 
-	size_t i;
-	for (i = 0; i < symbols*MAX_STATES; i++)
+// Deja el automata vacio, con NFA_HEAP_DENSE libera las tablas densas
+void nfa_free(nfa_t* nfa)
+{
+#ifndef NFA_NO_DENSE
+	nfa_dense_free(nfa);
+#endif
+	nfa_init(nfa, nfa->symbols);
+}
+
+// Indica si el automata usa la representacion dispersa
+bool nfa_is_sparse(const nfa_t* nfa)
+{
+	return nfa->sparse;
+}
+
+// Cambia la representacion de las transiciones del automata. Retorna false
+// si no es posible, por falta de espacio o porque no hay tablas densas
+bool nfa_set_sparse(nfa_t* nfa, bool sparse)
+{
+	if (nfa->sparse == sparse) return true;
+#ifdef NFA_NO_DENSE
+	return false;
+#else
+	state_t q;
+	symbol_t a;
+	bitset_iterator_t i;
+	if (sparse)
 	{
-		bitset_init(&nfa->forward[i]);
-		bitset_init(&nfa->backward[i]);
+		nfa_adjacency_t* adj = &nfa->adjacency;
+		nfa_adjacency_init(adj);
+		for (q = 0; q < MAX_STATES; q++)
+		{
+			for (a = 0; a < nfa->symbols; a++)
+			{
+				const bitset_t* bs = &nfa->forward[nfa_row(nfa, q, a)];
+				for (i = bitset_first(bs); !bitset_end(i); i = bitset_next(bs, i))
+				{
+					if (!nfa_adjacency_add(adj, q, bitset_element(i), a)) return false;
+				}
+			}
+		}
+		nfa->sparse = true;
+		nfa_dense_free(nfa);
+	}
+	else
+	{
+		if (!nfa_dense_reserve(nfa)) return false;
+		nfa_dense_init(nfa);
+		nfa->sparse = false;
+		const nfa_adjacency_t* adj = &nfa->adjacency;
+		for (q = 0; q < MAX_STATES; q++)
+		{
+			edge_index_t e;
+			for (e = adj->out[q]; e != NO_EDGE; e = adj->edge[e].next_out)
+			{
+				nfa_add_transition(nfa, q, adj->edge[e].q1, adj->edge[e].a);
+			}
+		}
 	}
+	return true;
+#endif
+}
+
+// Indica si las tablas densas usan la disposicion por simbolo
+bool nfa_is_symbol_major(const nfa_t* nfa)
+{
+	return nfa->symbol_major;
+}
+
+// Cambia la disposicion de las tablas densas
+bool nfa_set_symbol_major(nfa_t* nfa, bool symbol_major)
+{
+	if (nfa->symbol_major == symbol_major) return true;
+#ifdef NFA_NO_DENSE
+	return false;
+#else
+	if (nfa->sparse)
+	{
+		// las tablas se llenan con la nueva disposicion al pasar a densa
+		nfa->symbol_major = symbol_major;
+		return true;
+	}
+	size_t rows = (size_t)nfa->symbols * MAX_STATES;
+	bitset_t* forward = (bitset_t*)malloc(rows * sizeof(bitset_t));
+	bitset_t* backward = (bitset_t*)malloc(rows * sizeof(bitset_t));
+	if (forward == NULL || backward == NULL)
+	{
+		free(forward);
+		free(backward);
+		return false;
+	}
+	memcpy(forward, nfa->forward, rows * sizeof(bitset_t));
+	memcpy(backward, nfa->backward, rows * sizeof(bitset_t));
+	nfa->symbol_major = symbol_major;
+	state_t q;
+	symbol_t a;
+	for (q = 0; q < MAX_STATES; q++)
+	{
+		for (a = 0; a < nfa->symbols; a++)
+		{
+			// posicion en la disposicion anterior
+			size_t old = symbol_major ? (size_t)q * nfa->symbols + a : (size_t)a * MAX_STATES + q;
+			size_t row = nfa_row(nfa, q, a);
+			nfa->forward[row] = forward[old];
+			nfa->backward[row] = backward[old];
+		}
+	}
+	free(forward);
+	free(backward);
+	return true;
+#endif
+}
+
+// Comprueba si existe la transicion q0 -> q1 (usando el simbolo a)
+bool nfa_has_transition(const nfa_t* nfa,
+	state_t q0,
+	state_t q1,
+	symbol_t a)
+{
+	assert(a < nfa_get_symbols(nfa));
+	assert(q0 < nfa_get_states(nfa));
+	assert(q1 < nfa_get_states(nfa));
+
+	if (nfa->sparse)
+	{
+		return nfa_adjacency_find(&nfa->adjacency, q0, q1, a) != NO_EDGE;
+	}
+#ifndef NFA_NO_DENSE
+	return bitset_contains(&nfa->forward[nfa_row(nfa, q0, a)], q1);
+#else
+	return false;
+#endif
 }
 
 // Agrega una transition entre dos estados con un simbolo.
 // El estado destino esta representado con iterador de bitset_t.
 // La transicion es de q0 -> q1 (usando el simbolo a)
-void nfa_add_transition(nfa_t* nfa,
+bool nfa_add_transition(nfa_t* nfa,
 	state_t q0,
 	state_t q1,
 	symbol_t a)
@@ -139,13 +501,31 @@ void nfa_add_transition(nfa_t* nfa,
 	assert(q0 < nfa_get_states(nfa));
 	assert(q1 < nfa_get_states(nfa));
 
+	nfa->version++;
+	if (nfa->sparse)
+	{
+		if (nfa_adjacency_add(&nfa->adjacency, q0, q1, a))
+		{
+#ifndef NFA_NO_DENSE
+			// con suficientes transiciones las tablas ocupan menos. Si no hay
+			// memoria para ellas se sigue con las listas
+			if (nfa_dense_pays_off(nfa)) nfa_set_sparse(nfa, false);
+#endif
+			return true;
+		}
+		// sin espacio en la representacion dispersa
+		if (!nfa_set_sparse(nfa, false)) return false;
+	}
+#ifndef NFA_NO_DENSE
 	size_t offset;
 	// successor
-	offset = q0 * nfa_get_symbols(nfa) + a;
+	offset = nfa_row(nfa, q0, a);
 	bitset_add(&nfa->forward[offset], q1);
 	// predecessor
-	offset = q1 * nfa_get_symbols(nfa) + a;
+	offset = nfa_row(nfa, q1, a);
 	bitset_add(&nfa->backward[offset], q0);
+#endif
+	return true;
 }
 
 // Elimina una transition entre dos estados con un simbolo.
@@ -160,27 +540,82 @@ void nfa_remove_transition(nfa_t* nfa,
 	assert(q0 < nfa_get_states(nfa));
 	assert(q1 < nfa_get_states(nfa));
 
+	nfa->version++;
+	if (nfa->sparse)
+	{
+		nfa_adjacency_remove(&nfa->adjacency, q0, q1, a);
+		return;
+	}
+#ifndef NFA_NO_DENSE
 	size_t offset;
 	// successor
-	offset = q0 * nfa_get_symbols(nfa) + a;
+	offset = nfa_row(nfa, q0, a);
 	bitset_remove(&nfa->forward[offset], q1);
 	// predecessor
-	offset = q1 * nfa_get_symbols(nfa) + a;
+	offset = nfa_row(nfa, q1, a);
 	bitset_remove(&nfa->backward[offset], q0);
+#endif
 }
 
-// Copia el NFA de fuente en destino
-void nfa_clone(nfa_t* dest, const nfa_t* src)
+// Copia el NFA de fuente en destino. Solo se copia la parte en uso de la
+// representacion de las transiciones. Con NFA_HEAP_DENSE, si la fuente es
+// dispersa se liberan las tablas densas del destino
+bool nfa_clone(nfa_t* dest, const nfa_t* src)
 {
-	*dest = *src;
+#if defined(NFA_HEAP_DENSE) && !defined(NFA_NO_DENSE)
+	dest->symbols = src->symbols;
+	if (src->sparse)
+	{
+		nfa_dense_free(dest);
+	}
+	else if (!nfa_dense_reserve(dest))
+	{
+		nfa_free(dest);
+		return false;
+	}
+#endif
+	dest->initials = src->initials;
+	dest->finals = src->finals;
+	dest->symbols = src->symbols;
+	dest->sparse = src->sparse;
+	dest->symbol_major = src->symbol_major;
+	dest->version = nfa_new_version();
+
+	const nfa_adjacency_t* sadj = &src->adjacency;
+	nfa_adjacency_t* dadj = &dest->adjacency;
+	memcpy(dadj->out, sadj->out, sizeof(sadj->out));
+	memcpy(dadj->in, sadj->in, sizeof(sadj->in));
+	dadj->free = sadj->free;
+	dadj->used = sadj->used;
+	dadj->edges = sadj->edges;
+	if (src->sparse)
+	{
+		memcpy(dadj->edge, sadj->edge, sadj->used * sizeof(nfa_edge_t));
+		return true;
+	}
+#ifndef NFA_NO_DENSE
+	size_t rows = src->symbols * MAX_STATES;
+	memcpy(dest->forward, src->forward, rows * sizeof(bitset_t));
+	memcpy(dest->backward, src->backward, rows * sizeof(bitset_t));
+#endif
+	return true;
 }
 
-// Combina dos estados en un automata, el estado Q2 queda aislado
-void nfa_merge_states(nfa_t* nfa, state_t q1, state_t q2)
+// Cantidad de bytes que copia nfa_clone para el automata
+size_t nfa_clone_size(const nfa_t* nfa)
 {
-	assert(q1 < nfa_get_states(nfa));
-	assert(q2 < nfa_get_states(nfa));
+	size_t bytes = 2 * sizeof(bitset_t) + sizeof(symbol_t) + 2 * sizeof(bool)
+		+ 2 * MAX_STATES * sizeof(edge_index_t) + 3 * sizeof(edge_index_t);
+	if (nfa->sparse)
+	{
+		return bytes + nfa->adjacency.used * sizeof(nfa_edge_t);
+	}
+	return bytes + 2 * nfa->symbols * MAX_STATES * sizeof(bitset_t);
+}
 
+// Pasa a Q1 el caracter inicial y final de Q2
+void nfa_merge_ends(nfa_t* nfa, state_t q1, state_t q2)
+{
 	if (nfa_is_initial(nfa, q2))
 	{
 		nfa_add_initial(nfa, q1);
@@ -191,6 +626,118 @@ void nfa_merge_states(nfa_t* nfa, state_t q1, state_t q2)
 		nfa_add_final(nfa, q1);
 		nfa_remove_final(nfa, q2);
 	}
+}
+
+// Registra un cambio sobre la transicion q0 -> q1 (usando el simbolo a)
+void nfa_log_edit(nfa_merge_log_t* log, state_t q0, state_t q1, symbol_t a, bool added)
+{
+	assert(log->edits < log->capacity);
+	nfa_edit_t* e = &log->edit[log->edits++];
+	e->q0 = q0;
+	e->q1 = q1;
+	e->a = a;
+	e->added = added;
+}
+
+#ifndef NFA_NO_DENSE
+// Combina dos estados sobre las tablas densas trabajando por palabras. Para
+// cada simbolo las filas de Q2 se unen a las de Q1 con una operacion por
+// bucket, y en las filas de los predecesores y sucesores de Q2 el bit de Q2
+// se cambia por el de Q1 con mascaras precalculadas, sin recalcular
+// posiciones ni consultar la representacion por transicion. Si log no es
+// NULL registra solo las transiciones que cambian, como
+// nfa_merge_states_logged
+void nfa_dense_merge(nfa_t* nfa, state_t q1, state_t q2, nfa_merge_log_t* log)
+{
+	symbol_t symbols = nfa->symbols;
+	nfa->version++;
+	bucket_index_t w1 = q1 / BUCKET_BITS;
+	bucket_index_t w2 = q2 / BUCKET_BITS;
+	bucket_t m1 = (bucket_t)1 << (q1 % BUCKET_BITS);
+	bucket_t m2 = (bucket_t)1 << (q2 % BUCKET_BITS);
+	bitset_iterator_t i;
+	bucket_index_t k;
+	symbol_t c;
+	for (c = 0; c < symbols; c++)
+	{
+		bitset_t* f1 = &nfa->forward[nfa_row(nfa, q1, c)];
+		bitset_t* b1 = &nfa->backward[nfa_row(nfa, q1, c)];
+		bitset_t* f2 = &nfa->forward[nfa_row(nfa, q2, c)];
+		bitset_t* b2 = &nfa->backward[nfa_row(nfa, q2, c)];
+		bitset_t pred = *b2;
+		bitset_t succ = *f2;
+		bitset_init(f2);
+		bitset_init(b2);
+
+		// el lazo en Q2 se convierte en un lazo en Q1
+		bool loop = (pred.buckets[w2] & m2) != 0;
+		pred.buckets[w2] &= ~m2;
+		succ.buckets[w2] &= ~m2;
+		if (loop && log != NULL) nfa_log_edit(log, q2, q2, c, false);
+
+		// la columna de Q2 pasa a Q1 en las filas de los predecesores, y los
+		// predecesores de Q2 se unen a los de Q1
+		for (i = bitset_first(&pred); !bitset_end(i); i = bitset_next(&pred, i))
+		{
+			state_t p = bitset_element(i);
+			bucket_t* row = nfa->forward[nfa_row(nfa, p, c)].buckets;
+			bool added = (row[w1] & m1) == 0;
+			row[w2] &= ~m2;
+			row[w1] |= m1;
+			if (log != NULL)
+			{
+				nfa_log_edit(log, p, q2, c, false);
+				if (added) nfa_log_edit(log, p, q1, c, true);
+			}
+		}
+		for (k = 0; k < MAX_BUCKETS; k++)
+		{
+			b1->buckets[k] |= pred.buckets[k];
+		}
+
+		// igual con los sucesores
+		for (i = bitset_first(&succ); !bitset_end(i); i = bitset_next(&succ, i))
+		{
+			state_t q = bitset_element(i);
+			bucket_t* row = nfa->backward[nfa_row(nfa, q, c)].buckets;
+			bool added = (row[w1] & m1) == 0;
+			row[w2] &= ~m2;
+			row[w1] |= m1;
+			if (log != NULL)
+			{
+				nfa_log_edit(log, q2, q, c, false);
+				if (added) nfa_log_edit(log, q1, q, c, true);
+			}
+		}
+		for (k = 0; k < MAX_BUCKETS; k++)
+		{
+			f1->buckets[k] |= succ.buckets[k];
+		}
+
+		if (loop && (f1->buckets[w1] & m1) == 0)
+		{
+			f1->buckets[w1] |= m1;
+			b1->buckets[w1] |= m1;
+			if (log != NULL) nfa_log_edit(log, q1, q1, c, true);
+		}
+	}
+}
+#endif
+
+// Combina dos estados en un automata, el estado Q2 queda aislado
+void nfa_merge_states(nfa_t* nfa, state_t q1, state_t q2)
+{
+	assert(q1 < nfa_get_states(nfa));
+	assert(q2 < nfa_get_states(nfa));
+
+	nfa_merge_ends(nfa, q1, q2);
+#ifndef NFA_NO_DENSE
+	if (!nfa->sparse)
+	{
+		nfa_dense_merge(nfa, q1, q2, NULL);
+		return;
+	}
+#endif
 	symbol_t c;
 	for (c = 0; c < nfa->symbols; c++)
 	{
@@ -200,20 +747,141 @@ void nfa_merge_states(nfa_t* nfa, state_t q1, state_t q2)
 		bitset_iterator_t i;
 		for (i = bitset_first(&bs); !bitset_end(i); i = bitset_next(&bs, i))
 		{
-			nfa_add_transition(nfa, bitset_element(i), q1, c);
+			// se elimina antes de agregar para no superar la cantidad de
+			// transiciones inicial
 			nfa_remove_transition(nfa, bitset_element(i), q2, c);
+			nfa_add_transition(nfa, bitset_element(i), q1, c);
 		}
 
 		nfa_get_sucessors(nfa, q2, c, &bs);
 		bitset_iterator_t j;
 		for (j = bitset_first(&bs); !bitset_end(j); j = bitset_next(&bs, j))
 		{
-			nfa_add_transition(nfa, q1, bitset_element(j), c);
 			nfa_remove_transition(nfa, q2, bitset_element(j), c);
+			nfa_add_transition(nfa, q1, bitset_element(j), c);
 		}
 	}
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// NFA MERGE LOG
+
+// Inicializa un registro de mezcla vacio para automatas de symbols simbolos
+bool nfa_merge_log_init(nfa_merge_log_t* log, symbol_t symbols)
+{
+	bitset_init(&log->initials);
+	bitset_init(&log->finals);
+	log->edits = 0;
+	log->capacity = MAX_MERGE_EDITS(symbols);
+	log->edit = (nfa_edit_t*)malloc(log->capacity * sizeof(nfa_edit_t));
+	if (log->edit == NULL) log->capacity = 0;
+	return log->edit != NULL;
+}
+
+// Libera la memoria del registro
+void nfa_merge_log_free(nfa_merge_log_t* log)
+{
+	free(log->edit);
+	log->edit = NULL;
+	log->capacity = 0;
+	log->edits = 0;
+}
+
+// Agrega la transicion q0 -> q1 si no existe y registra el cambio
+void nfa_logged_add_transition(nfa_t* nfa, nfa_merge_log_t* log,
+	state_t q0,
+	state_t q1,
+	symbol_t a)
+{
+	if (nfa_has_transition(nfa, q0, q1, a)) return;
+
+	nfa_log_edit(log, q0, q1, a, true);
+	nfa_add_transition(nfa, q0, q1, a);
+}
+
+// Elimina la transicion q0 -> q1 si existe y registra el cambio
+void nfa_logged_remove_transition(nfa_t* nfa, nfa_merge_log_t* log,
+	state_t q0,
+	state_t q1,
+	symbol_t a)
+{
+	if (!nfa_has_transition(nfa, q0, q1, a)) return;
+
+	nfa_log_edit(log, q0, q1, a, false);
+	nfa_remove_transition(nfa, q0, q1, a);
+}
+
+// Combina dos estados en un automata registrando los cambios realizados en
+// log. El estado Q2 queda aislado. El resultado es identico al de
+// nfa_merge_states
+void nfa_merge_states_logged(nfa_t* nfa, state_t q1, state_t q2, nfa_merge_log_t* log)
+{
+	assert(q1 < nfa_get_states(nfa));
+	assert(q2 < nfa_get_states(nfa));
+
+	log->initials = nfa->initials;
+	log->finals = nfa->finals;
+	log->edits = 0;
+
+	nfa_merge_ends(nfa, q1, q2);
+#ifndef NFA_NO_DENSE
+	if (!nfa->sparse)
+	{
+		nfa_dense_merge(nfa, q1, q2, log);
+		return;
+	}
+#endif
+	symbol_t c;
+	for (c = 0; c < nfa->symbols; c++)
+	{
+		bitset_t bs;
+
+		nfa_get_predecessors(nfa, q2, c, &bs);
+		bitset_iterator_t i;
+		for (i = bitset_first(&bs); !bitset_end(i); i = bitset_next(&bs, i))
+		{
+			nfa_logged_remove_transition(nfa, log, bitset_element(i), q2, c);
+			nfa_logged_add_transition(nfa, log, bitset_element(i), q1, c);
+		}
+
+		nfa_get_sucessors(nfa, q2, c, &bs);
+		bitset_iterator_t j;
+		for (j = bitset_first(&bs); !bitset_end(j); j = bitset_next(&bs, j))
+		{
+			nfa_logged_remove_transition(nfa, log, q2, bitset_element(j), c);
+			nfa_logged_add_transition(nfa, log, q1, bitset_element(j), c);
+		}
+	}
+}
+
+// Deshace la mezcla registrada en log, el automata queda como estaba antes
+// de nfa_merge_states_logged
+void nfa_merge_rollback(nfa_t* nfa, nfa_merge_log_t* log)
+{
+	// los cambios se deshacen en orden inverso
+	while (log->edits > 0)
+	{
+		const nfa_edit_t* e = &log->edit[--log->edits];
+		if (e->added)
+		{
+			nfa_remove_transition(nfa, e->q0, e->q1, e->a);
+		}
+		else
+		{
+			nfa_add_transition(nfa, e->q0, e->q1, e->a);
+		}
+	}
+	nfa->initials = log->initials;
+	nfa->finals = log->finals;
+	nfa->version++;
+}
+
+// Confirma la mezcla registrada en log, que queda vacio
+void nfa_merge_commit(nfa_merge_log_t* log)
+{
+	log->edits = 0;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // NFA UTILS
 
@@ -233,7 +901,7 @@ sample_iterator_t sample_iterator_end(uint16_t length)
 	return r;
 }
 
-sample_iterator_t sample_iterator_next(const index_t indices[MAX_INDICES],
+sample_iterator_t sample_iterator_next(const index_t* indices,
 		sample_iterator_t i)
 {
 	if(i.sample < indices[i.index].samples - 1)
@@ -251,9 +919,193 @@ bool sample_iterator_equals(sample_iterator_t a, sample_iterator_t b)
 	return (a.sample == b.sample) && (a.index == b.index);
 }
 
+// Nucleo de un paso de simulacion con la disposicion por simbolo: une en
+// next las filas de la matriz rows (MAX_STATES filas contiguas de un simbolo)
+// de los estados de current
+typedef void (*nfa_step_kernel_t)(const bitset_t* rows, const bitset_t* current, bitset_t* next);
+
+// Producto de la matriz por el conjunto. Cada bucket no vacio de current
+// selecciona sus filas con una mascara, sin saltos por estado
+void nfa_step_generic(const bitset_t* rows, const bitset_t* current, bitset_t* next)
+{
+	bitset_t acc;
+	bitset_init(&acc);
+	bucket_index_t k;
+	for (k = 0; k < MAX_BUCKETS; k++)
+	{
+		bucket_t word = current->buckets[k];
+		if (word == 0) continue;
+		const bitset_t* block = rows + (size_t)k * BUCKET_BITS;
+		// el ultimo bucket tiene una fila menos, MAX_STATES < BITSET_BITS
+		state_t count = MAX_STATES - k * BUCKET_BITS;
+		if (count > BUCKET_BITS) count = BUCKET_BITS;
+		state_t b;
+		for (b = 0; b < count; b++)
+		{
+			bucket_t mask = (bucket_t)0 - ((word >> b) & 1);
+			bucket_index_t w;
+			for (w = 0; w < MAX_BUCKETS; w++)
+			{
+				acc.buckets[w] |= block[b].buckets[w] & mask;
+			}
+		}
+	}
+	*next = acc;
+}
+
+#ifdef NFA_STEP_SIMD
+// Igual que nfa_step_generic, recorriendo solo los estados de current y
+// uniendo cada fila con instrucciones de 256 bits
+#define NFA_STEP_AVX2_VECTORS (BITSET_BITS / 256)
+__attribute__((target("avx2")))
+void nfa_step_avx2(const bitset_t* rows, const bitset_t* current, bitset_t* next)
+{
+	__m256i acc[NFA_STEP_AVX2_VECTORS];
+	int v;
+	for (v = 0; v < NFA_STEP_AVX2_VECTORS; v++)
+	{
+		acc[v] = _mm256_setzero_si256();
+	}
+	bucket_index_t k;
+	for (k = 0; k < MAX_BUCKETS; k++)
+	{
+		bucket_t word = current->buckets[k];
+		while (word != 0)
+		{
+			state_t q = k * BUCKET_BITS + __builtin_ctzll(word);
+			word &= word - 1;
+			const __m256i* row = (const __m256i*)rows[q].buckets;
+			for (v = 0; v < NFA_STEP_AVX2_VECTORS; v++)
+			{
+				acc[v] = _mm256_or_si256(acc[v], _mm256_loadu_si256(row + v));
+			}
+		}
+	}
+	for (v = 0; v < NFA_STEP_AVX2_VECTORS; v++)
+	{
+		_mm256_storeu_si256((__m256i*)next->buckets + v, acc[v]);
+	}
+}
+
+#if BITSET_BITS >= 512
+// Igual que nfa_step_avx2 con instrucciones de 512 bits
+#define NFA_STEP_AVX512_VECTORS (BITSET_BITS / 512)
+__attribute__((target("avx512f")))
+void nfa_step_avx512(const bitset_t* rows, const bitset_t* current, bitset_t* next)
+{
+	__m512i acc[NFA_STEP_AVX512_VECTORS];
+	int v;
+	for (v = 0; v < NFA_STEP_AVX512_VECTORS; v++)
+	{
+		acc[v] = _mm512_setzero_si512();
+	}
+	bucket_index_t k;
+	for (k = 0; k < MAX_BUCKETS; k++)
+	{
+		bucket_t word = current->buckets[k];
+		while (word != 0)
+		{
+			state_t q = k * BUCKET_BITS + __builtin_ctzll(word);
+			word &= word - 1;
+			const __m512i* row = (const __m512i*)rows[q].buckets;
+			for (v = 0; v < NFA_STEP_AVX512_VECTORS; v++)
+			{
+				acc[v] = _mm512_or_si512(acc[v], _mm512_loadu_si512(row + v));
+			}
+		}
+	}
+	for (v = 0; v < NFA_STEP_AVX512_VECTORS; v++)
+	{
+		_mm512_storeu_si512((__m512i*)next->buckets + v, acc[v]);
+	}
+}
+#endif
+#endif
+
+// Escoge el nucleo de nfa_step segun el procesador. La consulta solo lee
+// una variable inicializada por el compilador al iniciar el programa
+nfa_step_kernel_t nfa_select_step_kernel(const char** name)
+{
+#ifdef NFA_STEP_SIMD
+#if BITSET_BITS >= 512
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		if (name != NULL) *name = "avx512";
+		return nfa_step_avx512;
+	}
+#endif
+	if (__builtin_cpu_supports("avx2"))
+	{
+		if (name != NULL) *name = "avx2";
+		return nfa_step_avx2;
+	}
+#endif
+	if (name != NULL) *name = "generic";
+	return nfa_step_generic;
+}
+
+#ifndef NFA_NO_DENSE
+// Igual que nfa_accept_sample con la disposicion por simbolo: cada paso es
+// un producto de la matriz del simbolo por el conjunto actual
+bool nfa_accept_sample_matrix(const nfa_t* nfa, const symbol_t* sample, uint16_t length)
+{
+#ifdef NFA_STEP_SIMD
+	nfa_step_kernel_t kernel = nfa_select_step_kernel(NULL);
+#else
+	nfa_step_kernel_t kernel = nfa_step_generic;
+#endif
+	bitset_t current;
+	bitset_t next;
+	nfa_get_initials(nfa, &current);
+	uint16_t i;
+	for (i = 0; i < length; i++)
+	{
+		kernel(&nfa->forward[(size_t)sample[i] * MAX_STATES], &current, &next);
+		if (!bitset_any(&next)) return false;
+		current = next;
+	}
+	bitset_t finals;
+	nfa_get_finals(nfa, &finals);
+	bitset_intersect(&current, &finals);
+	return bitset_any(&current);
+}
+#endif
+
+const char* nfa_step_kernel(void)
+{
+	const char* name;
+	nfa_select_step_kernel(&name);
+	return name;
+}
+
+// Obtiene en next los estados alcanzables desde current con el simbolo a
+void nfa_step(const nfa_t* nfa, const bitset_t* current, symbol_t a, bitset_t* next)
+{
+#ifndef NFA_NO_DENSE
+	if (!nfa->sparse && nfa->symbol_major)
+	{
+		const bitset_t* rows = &nfa->forward[(size_t)a * MAX_STATES];
+#ifdef NFA_STEP_SIMD
+		nfa_select_step_kernel(NULL)(rows, current, next);
+#else
+		nfa_step_generic(rows, current, next);
+#endif
+		return;
+	}
+#endif
+	bitset_t tmp;
+	bitset_init(next);
+	bitset_iterator_t j;
+	for (j = bitset_first(current); !bitset_end(j); j = bitset_next(current, j))
+	{
+		nfa_get_sucessors(nfa, bitset_element(j), a, &tmp);
+		bitset_union(next, &tmp);
+	}
+}
+
 // Comprueba si el automata reconoce la secuencia suministrada
 bool nfa_accept_sample(const nfa_t* nfa,
-	const symbol_t sample[MAX_SAMPLE_LENGTH],
+	const symbol_t* sample,
 	uint16_t length)
 {
 #pragma HLS ARRAY_MAP variable=nfa->initials instance=initials_finals horizontal
@@ -263,6 +1115,13 @@ bool nfa_accept_sample(const nfa_t* nfa,
 #pragma HLS INTERFACE ap_bus port=nfa->forward
 #pragma HLS INTERFACE ap_fifo port=sample
 
+#ifndef NFA_NO_DENSE
+	if (!nfa->sparse && nfa->symbol_major)
+	{
+		return nfa_accept_sample_matrix(nfa, sample, length);
+	}
+#endif
+
 	bitset_t next;
 	bitset_t current;
 	bitset_t tmp;
@@ -299,30 +1158,214 @@ nfa_accept_sample_2_bsf:
 	return bitset_any(&current);
 }
 
-// Indica si e NFA acepta al menos una muestra
-bool nfa_accept_any_sample(const nfa_t* nfa,
-	const symbol_t sample_buffer[MAX_SAMPLE_BUFFER],
-	const uint32_t sample_buffer_length,
+// Cantidad de carriles en un lote
+uint8_t lanes_count(lane_t lanes)
+{
+	uint8_t c = 0;
+	while (lanes)
+	{
+		lanes &= lanes - 1;
+		c++;
+	}
+	return c;
+}
+
+// Comprueba a la vez cuales muestras de un lote reconoce el automata.
+// Todas las muestras miden length simbolos y la muestra k inicia en
+// sample_buffer + offset[k]. Cada muestra ocupa un carril (bit) de lane_t y
+// por cada estado se guarda el conjunto de carriles que se encuentran en el,
+// de manera que un paso de simulacion avanza todas las muestras a la vez.
+// Retorna el conjunto de carriles aceptados
+lane_t nfa_accept_batch(const nfa_t* nfa,
+	const symbol_t* sample_buffer,
+	const uint32_t* offset,
+	uint8_t lanes,
+	uint16_t length)
+{
+	assert(lanes > 0 && lanes <= NFA_BATCH_LANES);
+
+	// carriles en cada estado, solo son validos para estados en active
+	lane_t current[MAX_STATES];
+	lane_t next[MAX_STATES];
+	bitset_t active;
+	bitset_t next_active;
+	// carriles que leen cada simbolo en la posicion actual
+	lane_t by_symbol[MAX_SYMBOLS];
+	// simbolos leidos por al menos un carril en la posicion actual
+	symbol_t present[NFA_BATCH_LANES];
+	uint8_t present_count;
+
+	lane_t alive = lanes == NFA_BATCH_LANES ? ~(lane_t)0 : ((lane_t)1 << lanes) - 1;
+	symbol_t a;
+	for (a = 0; a < nfa->symbols; a++)
+	{
+		by_symbol[a] = 0;
+	}
+
+	bitset_iterator_t j;
+	nfa_get_initials(nfa, &active);
+	for (j = bitset_first(&active); !bitset_end(j); j = bitset_next(&active, j))
+	{
+		current[bitset_element(j)] = alive;
+	}
+
+	uint16_t i;
+	for (i = 0; i < length; i++)
+	{
+		// agrupa los carriles vivos segun el simbolo que leen
+		present_count = 0;
+		uint8_t k;
+		for (k = 0; k < lanes; k++)
+		{
+			if (!((alive >> k) & 1)) continue;
+			symbol_t sym = sample_buffer[offset[k] + i];
+			if (by_symbol[sym] == 0) present[present_count++] = sym;
+			by_symbol[sym] |= (lane_t)1 << k;
+		}
+
+		bitset_clear(&next_active);
+		for (j = bitset_first(&active); !bitset_end(j); j = bitset_next(&active, j))
+		{
+			state_t q = bitset_element(j);
+			lane_t cq = current[q];
+			uint8_t p;
+			for (p = 0; p < present_count; p++)
+			{
+				symbol_t sym = present[p];
+				lane_t moving = cq & by_symbol[sym];
+				if (!moving) continue;
+
+				bitset_t suc;
+				nfa_get_sucessors(nfa, q, sym, &suc);
+				bitset_iterator_t t;
+				for (t = bitset_first(&suc); !bitset_end(t); t = bitset_next(&suc, t))
+				{
+					state_t qt = bitset_element(t);
+					if (!bitset_contains(&next_active, qt))
+					{
+						bitset_add(&next_active, qt);
+						next[qt] = 0;
+					}
+					next[qt] |= moving;
+				}
+			}
+		}
+		for (k = 0; k < present_count; k++)
+		{
+			by_symbol[present[k]] = 0;
+		}
+
+		// los carriles que no quedan en ningun estado ya fueron rechazados
+		alive = 0;
+		for (j = bitset_first(&next_active); !bitset_end(j); j = bitset_next(&next_active, j))
+		{
+			state_t q = bitset_element(j);
+			current[q] = next[q];
+			alive |= next[q];
+		}
+		active = next_active;
+		if (!alive) return 0;
+	}
+
+	lane_t accepted = 0;
+	bitset_t finals;
+	nfa_get_finals(nfa, &finals);
+	bitset_intersect(&active, &finals);
+	for (j = bitset_first(&active); !bitset_end(j); j = bitset_next(&active, j))
+	{
+		accepted |= current[bitset_element(j)];
+	}
+	return accepted;
+}
+
+// Indica cuantas muestras, dadas por su posicion en el buffer, tienen el
+// resultado indicado por accept. Si stop_on_first se detiene en la primera
+int nfa_accept_offsets(const nfa_t* nfa,
+	const symbol_t* sample_buffer,
 	const uint16_t sample_length,
-	const index_t indices[MAX_INDICES], const uint16_t i_size,
-	sample_iterator_t begin, sample_iterator_t end)
+	const uint32_t* offset,
+	uint32_t count,
+	bool stop_on_first, bool accept)
 {
-	sample_iterator_t i;
-	for(i = begin; !sample_iterator_equals(i, end); i = sample_iterator_next(indices, i))
+	int c = 0;
+	uint32_t i;
+	for (i = 0; i < count; i += NFA_BATCH_LANES)
 	{
-		index_t desc = indices[i.index];
-		uint32_t offset = desc.stride * i.sample;
-		if (nfa_accept_sample(nfa, sample_buffer + offset, sample_length))
+		uint8_t lanes = count - i < NFA_BATCH_LANES ? count - i : NFA_BATCH_LANES;
+		lane_t all = lanes == NFA_BATCH_LANES ? ~(lane_t)0 : ((lane_t)1 << lanes) - 1;
+		lane_t r = nfa_accept_batch(nfa, sample_buffer, offset + i, lanes, sample_length);
+		if (!accept) r = ~r & all;
+		if (r)
 		{
-			return true;
+			if (stop_on_first) return 1;
+			c += lanes_count(r);
 		}
 	}
-	return false;
+	return c;
+}
+
+// Igual que nfa_accept_offsets, pero se detiene en cuanto la cantidad ya no
+// puede superar threshold. En tal caso retorna una cota superior de la
+// cantidad que es menor o igual a threshold, de lo contrario retorna la
+// cantidad exacta. Si hits no es NULL se incrementa hits[k] por cada muestra
+// k simulada que no tiene el resultado buscado, para que el llamador pueda
+// ordenar primero las muestras que mas ayudan a detenerse. Si simulated no
+// es NULL recibe la cantidad de muestras simuladas
+int nfa_accept_offsets_bounded(const nfa_t* nfa,
+	const symbol_t* sample_buffer,
+	const uint16_t sample_length,
+	const uint32_t* offset,
+	uint32_t count,
+	bool accept, int threshold,
+	uint32_t* hits, uint32_t* simulated)
+{
+	int c = 0;
+	uint32_t i;
+	for (i = 0; i < count; i += NFA_BATCH_LANES)
+	{
+		// cota: todas las muestras restantes tienen el resultado buscado
+		int bound = c + (int)(count - i);
+		if (bound <= threshold)
+		{
+			if (simulated != NULL) *simulated = i;
+			return bound;
+		}
+
+		uint8_t lanes = count - i < NFA_BATCH_LANES ? count - i : NFA_BATCH_LANES;
+		lane_t all = lanes == NFA_BATCH_LANES ? ~(lane_t)0 : ((lane_t)1 << lanes) - 1;
+		lane_t r = nfa_accept_batch(nfa, sample_buffer, offset + i, lanes, sample_length);
+		if (!accept) r = ~r & all;
+		c += lanes_count(r);
+		if (hits != NULL)
+		{
+			uint8_t l;
+			for (l = 0; l < lanes; l++)
+			{
+				if (!(r & ((lane_t)1 << l))) hits[i + l]++;
+			}
+		}
+	}
+	if (simulated != NULL) *simulated = count;
+	return c;
+}
+
+// Indica si e NFA acepta al menos una muestra
+bool nfa_accept_any_sample(const nfa_t* nfa,
+	const symbol_t* sample_buffer,
+	const uint32_t sample_buffer_length,
+	const uint16_t sample_length,
+	const index_t* indices, const uint16_t i_size,
+	sample_iterator_t begin, sample_iterator_t end)
+{
+	return nfa_accept_samples_generic(nfa,
+		sample_buffer, sample_buffer_length, sample_length,
+		indices, i_size, begin, end,
+		true, true) > 0;
 }
 
 #define UNITS 1024
 int nfa_accept_samples_generic_hw(const nfa_t* nfa,
-	const symbol_t sample_buffer[MAX_SAMPLE_BUFFER],
+	const symbol_t* sample_buffer,
 	const uint32_t sample_buffer_length,
 	const uint16_t sample_length,
 	const uint32_t offset[UNITS],
@@ -348,70 +1391,157 @@ int nfa_accept_samples_generic_hw(const nfa_t* nfa,
 
 
 int nfa_accept_samples_generic(const nfa_t* nfa,
-	const symbol_t sample_buffer[MAX_SAMPLE_BUFFER],
+	const symbol_t* sample_buffer,
 	const uint32_t sample_buffer_length,
 	const uint16_t sample_length,
-	const index_t indices[MAX_INDICES], const uint16_t i_size,
+	const index_t* indices, const uint16_t i_size,
 	sample_iterator_t begin, sample_iterator_t end,
 	bool stop_on_first, bool accept)
 {
+	// las muestras se agrupan en lotes que se simulan a la vez
+	uint32_t offset[NFA_BATCH_LANES];
+	uint8_t lanes = 0;
 	int c = 0;
 	sample_iterator_t i;
 	for(i = begin; !sample_iterator_equals(i,end); i = sample_iterator_next(indices, i))
 	{
 		index_t desc = indices[i.index];
-		uint32_t offset = desc.stride * i.sample;
-		bool r = nfa_accept_sample(nfa, sample_buffer + offset, sample_length);
-		if((r && accept) || (!r && !accept))
+		offset[lanes++] = desc.begin + desc.stride * i.sample;
+		if (lanes == NFA_BATCH_LANES)
 		{
-			c++;
-			if(stop_on_first) break;
+			c += nfa_accept_offsets(nfa, sample_buffer, sample_length,
+				offset, lanes, stop_on_first, accept);
+			if (stop_on_first && c > 0) return c;
+			lanes = 0;
 		}
 	}
+	if (lanes > 0)
+	{
+		c += nfa_accept_offsets(nfa, sample_buffer, sample_length,
+			offset, lanes, stop_on_first, accept);
+	}
 	return c;
 }
 
 // Indica si el NFA acepta todas las muestras
 bool nfa_accept_all_samples(const nfa_t* nfa,
-	const symbol_t sample_buffer[MAX_SAMPLE_BUFFER],
+	const symbol_t* sample_buffer,
 	const uint32_t sample_buffer_length,
 	const uint16_t sample_length,
-	const index_t indices[MAX_INDICES], const uint16_t i_size,
+	const index_t* indices, const uint16_t i_size,
 	sample_iterator_t begin, sample_iterator_t end)
 {
-	sample_iterator_t i;
-	for(i = begin; !sample_iterator_equals(i, end); i = sample_iterator_next(indices, i))
-	{
-		index_t desc = indices[i.index];
-		uint32_t offset = desc.stride * i.sample;
-		if (!nfa_accept_sample(nfa, sample_buffer + offset, sample_length))
-		{
-			return false;
-		}
-	}
-	return true;
+	return nfa_accept_samples_generic(nfa,
+		sample_buffer, sample_buffer_length, sample_length,
+		indices, i_size, begin, end,
+		true, false) == 0;
 }
 
 // Indica cuantas muestras el NFA acepta
 int nfa_accept_samples(const nfa_t* nfa,
-	const symbol_t sample_buffer[MAX_SAMPLE_BUFFER],
+	const symbol_t* sample_buffer,
 	const uint32_t sample_buffer_length,
 	const uint16_t sample_length,
-	const index_t indices[MAX_INDICES], const uint16_t i_size,
+	const index_t* indices, const uint16_t i_size,
 	sample_iterator_t begin, sample_iterator_t end)
 {
-	int c = 0;
-	sample_iterator_t i;
-	for(i = begin; !sample_iterator_equals(i, end); i = sample_iterator_next(indices, i))
+	return nfa_accept_samples_generic(nfa,
+		sample_buffer, sample_buffer_length, sample_length,
+		indices, i_size, begin, end,
+		false, false);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// NFA STEP CACHE
+
+// Inicializa una cache vacia
+void nfa_cache_init(nfa_cache_t* cache)
+{
+	cache->nfa = NULL;
+	cache->version = 0;
+	cache->epoch = 1;
+	cache->hits = 0;
+	cache->misses = 0;
+	uint32_t i;
+	for (i = 0; i < NFA_CACHE_ENTRIES; i++)
 	{
-		index_t desc = indices[i.index];
-		uint32_t offset = desc.stride * i.sample;
-		if (!nfa_accept_sample(nfa, sample_buffer + offset, sample_length))
+		cache->entry[i].epoch = 0;
+	}
+}
+
+// Invalida todas las entradas sin recorrerlas
+void nfa_cache_invalidate(nfa_cache_t* cache)
+{
+	cache->epoch++;
+	if (cache->epoch == 0)
+	{
+		// el contador dio la vuelta, las entradas viejas podrian coincidir
+		uint32_t i;
+		for (i = 0; i < NFA_CACHE_ENTRIES; i++)
 		{
-			c++;
+			cache->entry[i].epoch = 0;
 		}
+		cache->epoch = 1;
 	}
-	return c;
+}
+
+// Posicion en la cache del paso desde set con el simbolo a
+uint32_t nfa_cache_hash(const bitset_t* set, symbol_t a)
+{
+	uint64_t h = a + 1;
+	bucket_index_t i;
+	for (i = 0; i < MAX_BUCKETS; i++)
+	{
+		h = (h ^ set->buckets[i]) * 0x9E3779B97F4A7C15ull;
+	}
+	return (uint32_t)(h ^ (h >> 32)) & (NFA_CACHE_ENTRIES - 1);
+}
+
+// Obtiene en next los estados alcanzables desde current con el simbolo a
+void nfa_cache_step(const nfa_t* nfa, nfa_cache_t* cache,
+	const bitset_t* current, symbol_t a, bitset_t* next)
+{
+	// las entradas se invalidan si cambia el automata o si se modifico
+	if (cache->nfa != nfa || cache->version != nfa->version)
+	{
+		nfa_cache_invalidate(cache);
+		cache->nfa = nfa;
+		cache->version = nfa->version;
+	}
+	nfa_cache_entry_t* e = &cache->entry[nfa_cache_hash(current, a)];
+	if (e->epoch == cache->epoch && e->a == a && bitset_equals(&e->from, current))
+	{
+		cache->hits++;
+		*next = e->to;
+		return;
+	}
+	cache->misses++;
+
+	nfa_step(nfa, current, a, next);
+	e->from = *current;
+	e->to = *next;
+	e->a = a;
+	e->epoch = cache->epoch;
+}
+
+// Igual que nfa_accept_sample, usando la cache
+bool nfa_accept_sample_cached(const nfa_t* nfa, nfa_cache_t* cache,
+	const symbol_t* sample,
+	uint16_t length)
+{
+	bitset_t current;
+	bitset_t next;
+	nfa_get_initials(nfa, &current);
+	uint16_t i;
+	for (i = 0; i < length; i++)
+	{
+		nfa_cache_step(nfa, cache, &current, sample[i], &next);
+		if (!bitset_any(&next)) return false;
+		current = next;
+	}
+	nfa_get_finals(nfa, &next);
+	bitset_intersect(&current, &next);
+	return bitset_any(&current);
 }
 
 void nfa_print(const nfa_t* nfa)
@@ -32,9 +32,13 @@
 // Estos valores ajustan las cantidades maximas para estados y simbolos que se 
 // usaran en el NFA. Ya que las transiciones de estado en el NFA se representan
 // con bitset_t, ajuste de tal manera que pase _conformance_check_nfa().
-// Nota: si es necesario vuelva a ajustar MAX_BUCKETS y el tipo de dato de bucket_t
-#define MAX_STATES 63u
+// Por defecto MAX_STATES se deriva de BITSET_BITS
+#ifndef MAX_STATES
+#define MAX_STATES (BITSET_BITS - 1u)
+#endif
+#ifndef MAX_SYMBOLS
 #define MAX_SYMBOLS 255u
+#endif
 
 // Letra en el alfabeto del NFA
 typedef uint8_t symbol_t;
@@ -62,14 +66,92 @@ typedef struct _sample_iterator_t
 	uint16_t sample;
 } sample_iterator_t;
 
+// Las transiciones se pueden guardar en tablas densas de bitset_t indexadas
+// por estado y simbolo, o en listas de adyacencia (representacion dispersa).
+// Un NFA empieza en la representacion dispersa y pasa a la densa cuando las
+// listas ocupan al menos 1 / NFA_DENSE_RATIO de la memoria de las tablas, o
+// cuando las listas se llenan. Las tablas densas son parte de nfa_t y miden
+// MAX_STATES*MAX_SYMBOLS conjuntos, por lo que con BITSET_BITS grandes
+// conviene reducir tambien MAX_SYMBOLS al tamano del alfabeto. Si se define
+// NFA_NO_DENSE no hay tablas densas y siempre se usa la representacion
+// dispersa.
+// Solo en la compilacion nativa se puede definir NFA_HEAP_DENSE: las tablas
+// miden symbols * MAX_STATES conjuntos y se reservan con malloc al pasar a
+// la representacion densa, y el automata se debe liberar con nfa_free. El
+// flujo de hardware no puede usar memoria dinamica
+
+// Recorrer las listas cuesta mucho mas por transicion que unir filas de las
+// tablas, solo convienen con automatas muy dispersos. Con 128 el tiempo de
+// oil_scaling es el mismo que usando siempre las tablas, con 64 y 256 bits
+#ifndef NFA_DENSE_RATIO
+#define NFA_DENSE_RATIO 128u
+#endif
+
+// Cantidad maxima de transiciones en la representacion dispersa
+#ifndef MAX_SPARSE_EDGES
+#define MAX_SPARSE_EDGES (32u*MAX_STATES)
+#endif
+
+// Indice de una transicion en la representacion dispersa
+typedef uint32_t edge_index_t;
+#define NO_EDGE UINT32_MAX
+
+// Transicion q0 -> q1 (usando el simbolo a) en la representacion dispersa.
+// Cada transicion pertenece a la lista de salida de q0 y a la de entrada de q1
+typedef struct _nfa_edge_t
+{
+	state_t q0;
+	state_t q1;
+	symbol_t a;
+	edge_index_t next_out;
+	edge_index_t next_in;
+} nfa_edge_t;
+
+// Listas de adyacencia de la representacion dispersa
+typedef struct _nfa_adjacency_t
+{
+	// Primera transicion de salida y de entrada de cada estado
+	edge_index_t out[MAX_STATES];
+	edge_index_t in[MAX_STATES];
+	// Lista de transiciones libres, enlazadas por next_out
+	edge_index_t free;
+	// Transiciones usadas alguna vez, las demas no tienen contenido
+	edge_index_t used;
+	// Transiciones en las listas
+	edge_index_t edges;
+	nfa_edge_t edge[MAX_SPARSE_EDGES];
+} nfa_adjacency_t;
+
+// Las tablas densas se indexan por defecto estado * symbols + simbolo. En la
+// disposicion por simbolo (symbol major) se indexan simbolo * MAX_STATES +
+// estado, de manera que cada simbolo tiene una matriz de bits contigua de
+// MAX_STATES filas y un paso de simulacion es un producto de la matriz por
+// el conjunto de estados actual (ver nfa_step). Ambas ocupan las mismas
+// symbols * MAX_STATES filas
+
 // Representa un Non-Deterministic Finite Automata
 typedef struct _nfa_t
 {
 	bitset_t initials;
 	bitset_t finals;
+	symbol_t symbols;
+	// Indica si las transiciones estan en adjacency o en forward/backward
+	bool sparse;
+	// Indica si las tablas densas usan la disposicion por simbolo
+	bool symbol_major;
+	// Cambia con cada modificacion del automata, ver nfa_cache_t
+	uint64_t version;
+	nfa_adjacency_t adjacency;
+#if defined(NFA_HEAP_DENSE) && !defined(NFA_NO_DENSE)
+	// Tablas densas, NULL hasta que el automata pasa a la representacion
+	// densa. dense_rows es la cantidad de filas reservadas en cada una
+	bitset_t* forward;
+	bitset_t* backward;
+	size_t dense_rows;
+#elif !defined(NFA_NO_DENSE)
 	bitset_t forward[MAX_STATES*MAX_SYMBOLS];
 	bitset_t backward[MAX_STATES*MAX_SYMBOLS];
-	symbol_t symbols;
+#endif
 } nfa_t;
 
 void _conformance_check_nfa(void);
@@ -102,13 +184,43 @@ void nfa_get_sucessors(const nfa_t* nfa, state_t state, symbol_t sym, bitset_t*
 // Obtiene el conjunto de predecesores de un par estado-simbolo de un automata
 void nfa_get_predecessors(const nfa_t* nfa, state_t state, symbol_t sym, bitset_t* bs);
 
-// Inicializa un NFA de manera que queda sin estados ni transiciones
+// Inicializa un NFA de manera que queda sin estados ni transiciones, en la
+// representacion dispersa
 void nfa_init(nfa_t* nfa, symbol_t symbols);
 
+// Deja el automata vacio como con nfa_init. Con NFA_HEAP_DENSE ademas libera
+// sus tablas densas, y se debe llamar antes de descartar el automata o de
+// inicializarlo de nuevo
+void nfa_free(nfa_t* nfa);
+
+// Indica si el automata usa la representacion dispersa
+bool nfa_is_sparse(const nfa_t* nfa);
+
+// Cambia la representacion de las transiciones del automata. Retorna false
+// si no es posible, por falta de espacio o porque no hay tablas densas
+bool nfa_set_sparse(nfa_t* nfa, bool sparse);
+
+// Indica si las tablas densas usan la disposicion por simbolo
+bool nfa_is_symbol_major(const nfa_t* nfa);
+
+// Cambia la disposicion de las tablas densas, transponiendolas si el
+// automata esta en la representacion densa. La disposicion se conserva al
+// pasar entre la representacion dispersa y la densa. Retorna false si no
+// hay tablas densas o memoria para la transposicion
+bool nfa_set_symbol_major(nfa_t* nfa, bool symbol_major);
+
+// Comprueba si existe la transicion q0 -> q1 (usando el simbolo a)
+bool nfa_has_transition(const nfa_t* nfa,
+	state_t q0,
+	state_t q1,
+	symbol_t a);
+
 // Agrega una transition entre dos estados con un simbolo.
 // El estado destino esta representado con iterador de bitset_t.
-// La transicion es de q0 -> q1 (usando el simbolo a)
-void nfa_add_transition(nfa_t* nfa,
+// La transicion es de q0 -> q1 (usando el simbolo a). Retorna false si no
+// hay espacio para ella: las listas estan llenas y, con NFA_HEAP_DENSE, no
+// hay memoria para las tablas densas, o se compila con NFA_NO_DENSE
+bool nfa_add_transition(nfa_t* nfa,
 	state_t q0,
 	state_t q1,
 	symbol_t a);
@@ -121,12 +233,73 @@ void nfa_remove_transition(nfa_t* nfa,
 	state_t q1,
 	symbol_t a);
 
-// Copia el NFA de fuente en destino
-void nfa_clone(nfa_t* dest, const nfa_t* src);
+// Copia el NFA de fuente en destino. Solo se copia la parte en uso de la
+// representacion de las transiciones. Con NFA_HEAP_DENSE el destino debe
+// estar inicializado, sus tablas se reutilizan si alcanzan y se liberan si
+// la fuente es dispersa. Retorna false si no hay memoria para las tablas,
+// en tal caso el destino queda vacio
+bool nfa_clone(nfa_t* dest, const nfa_t* src);
 
-// Combina dos estados en un automata, el estado Q2 queda aislado
+// Cantidad de bytes que copia nfa_clone para el automata
+size_t nfa_clone_size(const nfa_t* nfa);
+
+// Combina dos estados en un automata, el estado Q2 queda aislado. La mezcla
+// no aumenta la cantidad de transiciones, por lo que siempre es posible
 void nfa_merge_states(nfa_t* nfa, state_t q1, state_t q2);
 
+/////////////////////////////////////////////////////////////////////////////
+// NFA MERGE LOG
+// Permite aplicar una mezcla de estados de manera transaccional: se aplica
+// sobre el mismo automata registrando solo las transiciones que cambian, de
+// manera que se puede deshacer sin copiar el automata completo.
+
+// Cantidad maxima de cambios que puede registrar una mezcla en un automata
+// de symbols simbolos. Por cada simbolo se agregan y eliminan a lo sumo los
+// predecesores y sucesores de Q2
+#define MAX_MERGE_EDITS(symbols) (4u*MAX_STATES*(uint32_t)(symbols))
+
+// Cambio sobre una transicion q0 -> q1 (usando el simbolo a)
+typedef struct _nfa_edit_t
+{
+	state_t q0;
+	state_t q1;
+	symbol_t a;
+	// Indica si la transicion fue agregada, de lo contrario fue eliminada
+	bool added;
+} nfa_edit_t;
+
+// Registro de los cambios realizados por una mezcla de estados
+typedef struct _nfa_merge_log_t
+{
+	// Estados iniciales y finales antes de la mezcla
+	bitset_t initials;
+	bitset_t finals;
+	// Cantidad de cambios registrados
+	uint32_t edits;
+	// Cambios que caben en edit, MAX_MERGE_EDITS(symbols)
+	uint32_t capacity;
+	nfa_edit_t* edit;
+} nfa_merge_log_t;
+
+// Inicializa un registro de mezcla vacio para automatas de symbols simbolos.
+// Retorna false si no hay memoria
+bool nfa_merge_log_init(nfa_merge_log_t* log, symbol_t symbols);
+
+// Libera la memoria del registro
+void nfa_merge_log_free(nfa_merge_log_t* log);
+
+// Combina dos estados en un automata registrando los cambios realizados en
+// log. El estado Q2 queda aislado. El resultado es identico al de
+// nfa_merge_states
+void nfa_merge_states_logged(nfa_t* nfa, state_t q1, state_t q2, nfa_merge_log_t* log);
+
+// Deshace la mezcla registrada en log, el automata queda como estaba antes
+// de nfa_merge_states_logged
+void nfa_merge_rollback(nfa_t* nfa, nfa_merge_log_t* log);
+
+// Confirma la mezcla registrada en log, que queda vacio
+void nfa_merge_commit(nfa_merge_log_t* log);
+
 /////////////////////////////////////////////////////////////////////////////
 // NFA UTILS
 
@@ -136,44 +309,152 @@ void nfa_merge_states(nfa_t* nfa, state_t q1, state_t q2);
 
 sample_iterator_t sample_iterator_begin(void);
 sample_iterator_t sample_iterator_end(uint16_t length);
-sample_iterator_t sample_iterator_next(const index_t indices[MAX_INDICES],
+sample_iterator_t sample_iterator_next(const index_t* indices,
 	sample_iterator_t i);
+bool sample_iterator_equals(sample_iterator_t a, sample_iterator_t b);
+
+// Cantidad de muestras que se simulan a la vez en un lote
+#define NFA_BATCH_LANES 64
+
+// Conjunto de muestras de un lote, cada muestra ocupa un bit (carril)
+typedef uint64_t lane_t;
+
+// Cantidad de carriles en un lote
+uint8_t lanes_count(lane_t lanes);
+
+// Obtiene en next los estados alcanzables desde current con el simbolo a.
+// Con la disposicion por simbolo usa el nucleo de nfa_step_kernel
+void nfa_step(const nfa_t* nfa, const bitset_t* current, symbol_t a, bitset_t* next);
+
+// Nombre del nucleo que usa nfa_step con la disposicion por simbolo:
+// "generic", "avx2" o "avx512". Los nucleos vectoriales solo se compilan
+// con GCC para x86-64 y BITSET_BITS de al menos 256, y se escogen segun el
+// procesador al ejecutar
+const char* nfa_step_kernel(void);
 
 // Comprueba si el automata reconoce la secuencia suministrada
 bool nfa_accept_sample(const nfa_t* nfa,
-	const symbol_t sample[MAX_SAMPLE_LENGTH],
+	const symbol_t* sample,
+	uint16_t length);
+
+// Comprueba a la vez cuales muestras de un lote reconoce el automata.
+// Todas las muestras miden length simbolos y la muestra k inicia en
+// sample_buffer + offset[k]. Retorna el conjunto de carriles aceptados
+lane_t nfa_accept_batch(const nfa_t* nfa,
+	const symbol_t* sample_buffer,
+	const uint32_t* offset,
+	uint8_t lanes,
 	uint16_t length);
 
+// Indica cuantas muestras, dadas por su posicion en el buffer, tienen el
+// resultado indicado por accept. Si stop_on_first se detiene en la primera
+int nfa_accept_offsets(const nfa_t* nfa,
+	const symbol_t* sample_buffer,
+	const uint16_t sample_length,
+	const uint32_t* offset,
+	uint32_t count,
+	bool stop_on_first, bool accept);
+
+// Igual que nfa_accept_offsets, pero se detiene en cuanto la cantidad ya no
+// puede superar threshold. En tal caso retorna una cota superior de la
+// cantidad que es menor o igual a threshold, de lo contrario retorna la
+// cantidad exacta. Si hits no es NULL se incrementa hits[k] por cada muestra
+// k simulada que no tiene el resultado buscado, para que el llamador pueda
+// ordenar primero las muestras que mas ayudan a detenerse. Si simulated no
+// es NULL recibe la cantidad de muestras simuladas
+int nfa_accept_offsets_bounded(const nfa_t* nfa,
+	const symbol_t* sample_buffer,
+	const uint16_t sample_length,
+	const uint32_t* offset,
+	uint32_t count,
+	bool accept, int threshold,
+	uint32_t* hits, uint32_t* simulated);
+
 // Indica si e NFA acepta al menos una muestra
 bool nfa_accept_any_sample(const nfa_t* nfa,
-	const symbol_t sample_buffer[MAX_SAMPLE_BUFFER],
+	const symbol_t* sample_buffer,
 	const uint32_t sample_buffer_length,
 	const uint16_t sample_length,
-	const index_t indices[MAX_INDICES], const uint16_t i_size,
+	const index_t* indices, const uint16_t i_size,
 	sample_iterator_t begin, sample_iterator_t end);
 
 // Indica si el NFA acepta todas las muestras
 bool nfa_accept_all_samples(const nfa_t* nfa,
-	const symbol_t sample_buffer[MAX_SAMPLE_BUFFER],
+	const symbol_t* sample_buffer,
 	const uint32_t sample_buffer_length,
 	const uint16_t sample_length,
-	const index_t indices[MAX_INDICES], const uint16_t i_size,
+	const index_t* indices, const uint16_t i_size,
 	sample_iterator_t begin, sample_iterator_t end);
 
 // Indica cuantas muestras el NFA acepta
 int nfa_accept_samples(const nfa_t* nfa,
-	const symbol_t sample_buffer[MAX_SAMPLE_BUFFER],
+	const symbol_t* sample_buffer,
 	const uint32_t sample_buffer_length,
 	const uint16_t sample_length,
-	const index_t indices[MAX_INDICES], const uint16_t i_size,
+	const index_t* indices, const uint16_t i_size,
 	sample_iterator_t begin, sample_iterator_t end);
 
 int nfa_accept_samples_generic(const nfa_t* nfa,
-	const symbol_t sample_buffer[MAX_SAMPLE_BUFFER],
+	const symbol_t* sample_buffer,
 	const uint32_t sample_buffer_length,
 	const uint16_t sample_length,
-	const index_t indices[MAX_INDICES], const uint16_t i_size,
+	const index_t* indices, const uint16_t i_size,
 	sample_iterator_t begin, sample_iterator_t end,
 	bool stop_on_first, bool accept);
 
+/////////////////////////////////////////////////////////////////////////////
+// NFA STEP CACHE
+// Memoriza los pasos de simulacion (conjunto de estados, simbolo) ->
+// conjunto de estados siguiente, de manera que el NFA se determiniza a
+// medida que se simula. Sirve cuando se simulan muchas muestras sobre el
+// mismo automata y los mismos conjuntos de estados se repiten.
+
+// Cantidad de entradas de la cache, debe ser potencia de 2. Cada entrada
+// guarda dos bitset_t, la memoria usada no crece con las simulaciones
+#ifndef NFA_CACHE_ENTRIES
+#define NFA_CACHE_ENTRIES 4096u
+#endif
+
+// Paso memorizado: desde from con el simbolo a se llega a to. Solo es valido
+// si epoch coincide con el de la cache
+typedef struct _nfa_cache_entry_t
+{
+	bitset_t from;
+	bitset_t to;
+	uint32_t epoch;
+	symbol_t a;
+} nfa_cache_entry_t;
+
+// Cache de correspondencia directa: cada paso tiene una sola entrada
+// posible, que se reemplaza en caso de colision
+typedef struct _nfa_cache_t
+{
+	// Automata y version del mismo a los que corresponden las entradas
+	const nfa_t* nfa;
+	uint64_t version;
+	// Las entradas con otro epoch estan invalidadas
+	uint32_t epoch;
+	// Pasos encontrados y no encontrados en la cache
+	uint64_t hits;
+	uint64_t misses;
+	nfa_cache_entry_t entry[NFA_CACHE_ENTRIES];
+} nfa_cache_t;
+
+// Inicializa una cache vacia
+void nfa_cache_init(nfa_cache_t* cache);
+
+// Invalida todas las entradas sin recorrerlas. La cache se invalida sola al
+// usarla con otro automata o despues de modificar el automata con las
+// funciones de nfa.h
+void nfa_cache_invalidate(nfa_cache_t* cache);
+
+// Obtiene en next los estados alcanzables desde current con el simbolo a
+void nfa_cache_step(const nfa_t* nfa, nfa_cache_t* cache,
+	const bitset_t* current, symbol_t a, bitset_t* next);
+
+// Igual que nfa_accept_sample, usando la cache
+bool nfa_accept_sample_cached(const nfa_t* nfa, nfa_cache_t* cache,
+	const symbol_t* sample,
+	uint16_t length);
+
 void nfa_print(const nfa_t* nfa);
@@ -12,16 +12,78 @@
 // Pontificia Universidad Javeriana Cali
 #include "nfa.h"
 #include "bitset.h"
+#include "oil.h"
+#include "trie.h"
+#include "reduce.h"
+#include "alphabet.h"
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <unistd.h>
+#ifdef OIL_THREADS
+#include "workers.h"
+#define OIL_FETCH_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define OIL_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define OIL_CAS(p, e, v) __atomic_compare_exchange_n((p), (e), (v), false, \
+	__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+#define OIL_FETCH_ADD(p, v) ((*(p) += (v)) - (v))
+#define OIL_LOAD(p) (*(p))
+#define OIL_CAS(p, e, v) (*(p) = (v), true)
+#endif
+
+// Contadores de oil_metrics_t. Sin OIL_METRICS no generan codigo
+#ifdef OIL_METRICS
+#include <time.h>
+#define OIL_METRIC(m, field, v) do { if ((m) != NULL) (m)->field += (v); } while (0)
+#define OIL_METRIC_START(m, t) uint64_t t = (m) != NULL ? oil_metrics_now() : 0
+#define OIL_METRIC_ELAPSED(m, field, t) OIL_METRIC(m, field, oil_metrics_now() - (t))
+
+// Tiempo monotono en nanosegundos
+uint64_t oil_metrics_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#else
+#define OIL_METRIC(m, field, v) do { } while (0)
+#define OIL_METRIC_START(m, t) do { } while (0)
+#define OIL_METRIC_ELAPSED(m, field, t) do { } while (0)
+#endif
 
 /////////////////////////////////////////////////////////////////////////////
 // OIL
 
+// Contexto de un hilo que evalua mezclas candidatas
+typedef struct _oil_worker_t
+{
+	// Hipotesis sobre la que el hilo evalua las mezclas
+	nfa_t* nfa;
+
+	// Registro para deshacer las mezclas evaluadas
+	nfa_merge_log_t* log;
+
+	// Version de la hipotesis copiada en nfa
+	unsigned version;
+
+	// Veces que cada muestra pendiente detuvo el puntaje de un candidato,
+	// NULL si las muestras pendientes no se ordenan
+	uint32_t* hits;
+
+	// Veces que cada muestra negativa descarto un candidato, NULL si no hay
+	// tablas de alcanzabilidad
+	uint32_t* kills;
+
+	// Contadores del hilo, apuntan a local_metrics o son NULL si no se
+	// recolectan. Se suman a los de la ejecucion al terminar cada tarea
+	oil_metrics_t* metrics;
+	oil_metrics_t local_metrics;
+} oil_worker_t;
+
 typedef struct _oil_state_t
 {
 	// Vector de estados aleatorio
@@ -36,16 +98,33 @@ typedef struct _oil_state_t
 	// NFA hipotesis
 	nfa_t* nfa;
 
+	// Registro para evaluar mezclas sobre el NFA hipotesis y deshacerlas
+	nfa_merge_log_t merge_log;
+
 	// Ejecuta el algoritmo de manera que no utiliza orden aleatorio
 	bool no_random_sort;
 
+	// Estado del generador pseudoaleatorio
+	uint64_t rng;
+
 	// Si se habilita, OIL se conformara con la primera mezcla de estados
 	// que se considere valida
 	bool skip_search_best;
 
+	// Evalua todos los candidatos sin descartar los que no pueden superar
+	// al mejor
+	bool no_prune;
+
+	// Revisa las muestras negativas en su orden original, sin adelantar las
+	// que mas candidatos descartan
+	bool no_kill_order;
+
 	// Estados en el automata
 	state_t states;
 
+	// Contadores de la ejecucion, NULL si no se recolectan
+	oil_metrics_t* metrics;
+
 	// Indice en el vector de estados aleatorio a partir del cual se encuentran
 	// los nuevos estados a ser combinados
 	state_t new_states_begin;
@@ -53,21 +132,96 @@ typedef struct _oil_state_t
 	// muestra positiva en la que se encuentra el procesamiento
 	sample_iterator_t current_sample;
 
+	// Posicion de current_sample al recorrer las muestras positivas
+	uint32_t current_ordinal;
+
+	// Indices de prefijos de las muestras positivas y negativas, NULL si
+	// las muestras se simulan una por una
+	sample_trie_t* ptrie;
+	sample_trie_t* ntrie;
+	sample_trie_t ptrie_storage;
+	sample_trie_t ntrie_storage;
+
+	// Muestras positivas que la hipotesis aun rechaza, en orden. Como las
+	// mezclas y los nuevos estados solo agrandan el lenguaje, una muestra
+	// aceptada no vuelve a ser rechazada y se retira de la lista. Para cada
+	// muestra se guarda su posicion en el buffer y su ordinal.
+	// NULL si no hay memoria para la lista
+	uint32_t* pending_offset;
+	uint32_t* pending_ordinal;
+	uint32_t pending;
+
+	// La lista se ordena para simular primero las muestras que los
+	// candidatos suelen aceptar, con las que el puntaje acotado se detiene
+	// antes. pending_hits acumula los contadores de cada hilo y rejected
+	// indica, por ordinal, si la muestra sigue en la lista
+	uint32_t* pending_hits;
+	bool* rejected;
+
+	// Tablas de alcanzabilidad de las muestras negativas. Para la muestra n y
+	// la posicion k, forward[n * (sample_length + 1) + k] son los estados
+	// alcanzados al leer los primeros k simbolos y backward[...] los estados
+	// desde los que el resto de la muestra lleva a un estado final.
+	// forward_any[n] y backward_any[n] son la union sobre todas las
+	// posiciones. NULL si las tablas no caben en la memoria disponible
+	bitset_t* forward;
+	bitset_t* backward;
+	bitset_t* forward_any;
+	bitset_t* backward_any;
+	uint32_t* negative_offset;
+	uint32_t negatives;
+
+	// Orden en que se revisan las muestras negativas: primero las que mas
+	// candidatos han descartado, segun negative_kills
+	uint32_t* negative_order;
+	uint32_t* negative_kills;
+
+	// Indica si la hipotesis ya acepta alguna muestra negativa, por ejemplo
+	// si tambien es positiva. En tal caso ninguna mezcla es valida
+	bool negative_accepted;
+
 	// Contador de mezclas exitosas realizadas
 	int merge_counter;
 
+	// Contador de mezclas candidatas evaluadas
+	uint64_t merge_attempts;
+
+	// Muestras positivas forzadas y checkpoints escritos
+	uint32_t coerced;
+	uint32_t checkpoints;
+
+	// Hilos que evaluan las mezclas candidatas. Con un solo hilo las mezclas
+	// se evaluan directamente sobre la hipotesis
+	int threads;
+	oil_worker_t worker[OIL_MAX_THREADS];
+
+	// Cambia cada vez que se modifica la hipotesis, para que cada hilo sepa
+	// cuando debe copiarla de nuevo
+	unsigned nfa_version;
+
+#ifdef OIL_THREADS
+	workers_t workers;
+#endif
+
 	bool print_merge_alternatives;
 	bool print_merges;
 	bool print_progress;
 } oil_state_t;
 
+// Generador pseudoaleatorio congruencial de cada ejecucion
+uint32_t oil_rand(oil_state_t* state)
+{
+	state->rng = state->rng * 6364136223846793005ull + 1442695040888963407ull;
+	return (uint32_t)(state->rng >> 33);
+}
+
 // Aplica orden aleatorio a una secuencia de estados
-void oil_random_shuffle(state_t* buffer, state_t len)
+void oil_random_shuffle(oil_state_t* state, state_t* buffer, state_t len)
 {
 	state_t i;
 	for (i=len-1; i>0; i--)
 	{
-		state_t j = rand() % (i + 1);
+		state_t j = oil_rand(state) % (i + 1);
 		// swap
 		state_t tmp = buffer[i];
 		buffer[i] = buffer[j];
@@ -75,11 +229,370 @@ void oil_random_shuffle(state_t* buffer, state_t len)
 	}
 }
 
+// Libera las tablas de alcanzabilidad de las muestras negativas
+void oil_free_reachability(oil_state_t* state)
+{
+	free(state->forward);
+	free(state->backward);
+	free(state->forward_any);
+	free(state->backward_any);
+	free(state->negative_offset);
+	free(state->negative_order);
+	free(state->negative_kills);
+	state->forward = NULL;
+	state->backward = NULL;
+	state->forward_any = NULL;
+	state->backward_any = NULL;
+	state->negative_offset = NULL;
+	state->negative_order = NULL;
+	state->negative_kills = NULL;
+	int t;
+	for (t = 0; t < state->threads; t++)
+	{
+		free(state->worker[t].kills);
+		state->worker[t].kills = NULL;
+	}
+}
+
+// Suma los contadores de cada hilo a los de las muestras negativas y las
+// ordena de manera que primero se revisen las que mas candidatos descartan
+void oil_gather_kills(oil_state_t* state)
+{
+	if (state->forward == NULL) return;
+	uint32_t n;
+	int t;
+	for (t = 0; t < state->threads; t++)
+	{
+		uint32_t* kills = state->worker[t].kills;
+		for (n = 0; n < state->negatives; n++)
+		{
+			state->negative_kills[n] += kills[n];
+			kills[n] = 0;
+		}
+	}
+	if (state->no_kill_order) return;
+
+	// orden por insercion, la lista casi siempre esta ordenada
+	uint32_t p;
+	for (p = 1; p < state->negatives; p++)
+	{
+		n = state->negative_order[p];
+		uint32_t q = p;
+		while (q > 0 && state->negative_kills[state->negative_order[q - 1]] <
+			state->negative_kills[n])
+		{
+			state->negative_order[q] = state->negative_order[q - 1];
+			q--;
+		}
+		state->negative_order[q] = n;
+	}
+}
+
+// Libera la lista de muestras pendientes
+void oil_free_pending(oil_state_t* state)
+{
+	free(state->pending_offset);
+	free(state->pending_ordinal);
+	free(state->pending_hits);
+	free(state->rejected);
+	state->pending_offset = NULL;
+	state->pending_ordinal = NULL;
+	state->pending_hits = NULL;
+	state->rejected = NULL;
+	int t;
+	for (t = 0; t < state->threads; t++)
+	{
+		free(state->worker[t].hits);
+		state->worker[t].hits = NULL;
+	}
+}
+
+// Reserva la lista de muestras pendientes con todas las muestras positivas,
+// ya que el NFA vacio las rechaza. Si no hay memoria la lista queda en NULL
+void oil_init_pending(oil_state_t* state,
+	const index_t* pindices, const size_t ip_size, uint32_t samples)
+{
+	state->pending = 0;
+	state->pending_offset = (uint32_t*)malloc((samples + 1) * sizeof(uint32_t));
+	state->pending_ordinal = (uint32_t*)malloc((samples + 1) * sizeof(uint32_t));
+	state->pending_hits = (uint32_t*)calloc(samples + 1, sizeof(uint32_t));
+	state->rejected = (bool*)malloc((samples + 1) * sizeof(bool));
+	bool ok = state->pending_offset != NULL && state->pending_ordinal != NULL &&
+		state->pending_hits != NULL && state->rejected != NULL;
+	int t;
+	for (t = 0; t < state->threads; t++)
+	{
+		state->worker[t].hits = (uint32_t*)calloc(samples + 1, sizeof(uint32_t));
+		ok = ok && state->worker[t].hits != NULL;
+	}
+	if (!ok)
+	{
+		oil_free_pending(state);
+		return;
+	}
+
+	sample_iterator_t i;
+	for (i = sample_iterator_begin(); !sample_iterator_equals(i, sample_iterator_end(ip_size));
+		i = sample_iterator_next(pindices, i))
+	{
+		index_t desc = pindices[i.index];
+		state->pending_offset[state->pending] = desc.begin + desc.stride * i.sample;
+		state->pending_ordinal[state->pending] = state->pending;
+		state->rejected[state->pending] = true;
+		state->pending++;
+	}
+}
+
+// Inicializa los contadores en cero
+void oil_metrics_init(oil_metrics_t* metrics)
+{
+	memset(metrics, 0, sizeof(oil_metrics_t));
+}
+
+// Escribe los contadores como un objeto JSON en una linea
+void oil_metrics_json(const oil_metrics_t* metrics, FILE* out)
+{
+	fprintf(out, "{\"candidates\":%llu,\"candidates_pruned\":%llu,"
+		"\"negative_rejections_table\":%llu,\"negative_rejections\":%llu,"
+		"\"negative_simulations\":%llu,\"positive_simulations\":%llu,"
+		"\"symbol_steps\":%llu,\"samples_coerced\":%llu,\"merges\":%llu,"
+		"\"coerce_ns\":%llu,\"evaluate_ns\":%llu,\"commit_ns\":%llu,"
+		"\"total_ns\":%llu}\n",
+		(unsigned long long)metrics->candidates,
+		(unsigned long long)metrics->candidates_pruned,
+		(unsigned long long)metrics->negative_rejections_table,
+		(unsigned long long)metrics->negative_rejections,
+		(unsigned long long)metrics->negative_simulations,
+		(unsigned long long)metrics->positive_simulations,
+		(unsigned long long)metrics->symbol_steps,
+		(unsigned long long)metrics->samples_coerced,
+		(unsigned long long)metrics->merges,
+		(unsigned long long)metrics->coerce_ns,
+		(unsigned long long)metrics->evaluate_ns,
+		(unsigned long long)metrics->commit_ns,
+		(unsigned long long)metrics->total_ns);
+}
+
+// Suma los contadores de src a los de dst
+void oil_metrics_add(oil_metrics_t* dst, const oil_metrics_t* src)
+{
+	dst->candidates += src->candidates;
+	dst->candidates_pruned += src->candidates_pruned;
+	dst->negative_rejections_table += src->negative_rejections_table;
+	dst->negative_rejections += src->negative_rejections;
+	dst->negative_simulations += src->negative_simulations;
+	dst->positive_simulations += src->positive_simulations;
+	dst->symbol_steps += src->symbol_steps;
+	dst->samples_coerced += src->samples_coerced;
+	dst->merges += src->merges;
+	dst->coerce_ns += src->coerce_ns;
+	dst->evaluate_ns += src->evaluate_ns;
+	dst->commit_ns += src->commit_ns;
+	dst->total_ns += src->total_ns;
+}
+
+// Suma los contadores de cada hilo a los de la ejecucion
+void oil_gather_metrics(oil_state_t* state)
+{
+	if (state->metrics == NULL) return;
+	int t;
+	for (t = 0; t < state->threads; t++)
+	{
+		oil_metrics_add(state->metrics, &state->worker[t].local_metrics);
+		oil_metrics_init(&state->worker[t].local_metrics);
+	}
+}
+
+// Suma los contadores de cada hilo a los de la lista de muestras pendientes
+void oil_gather_hits(oil_state_t* state)
+{
+	if (state->pending_offset == NULL) return;
+	int t;
+	for (t = 0; t < state->threads; t++)
+	{
+		uint32_t* hits = state->worker[t].hits;
+		uint32_t p;
+		for (p = 0; p < state->pending; p++)
+		{
+			state->pending_hits[p] += hits[p];
+			hits[p] = 0;
+		}
+	}
+}
+
+// Retira de la lista de muestras pendientes las que la hipotesis ya acepta
+// y ordena las restantes por la cantidad de veces que detuvieron un puntaje
+void oil_compact_pending(oil_state_t* state,
+	const symbol_t* sample_buffer, const size_t sample_length)
+{
+	if (state->pending_offset == NULL) return;
+	OIL_METRIC(state->metrics, symbol_steps, (uint64_t)state->pending * sample_length);
+	uint32_t kept = 0;
+	uint32_t i;
+	for (i = 0; i < state->pending; i += NFA_BATCH_LANES)
+	{
+		uint8_t lanes = state->pending - i < NFA_BATCH_LANES ?
+			state->pending - i : NFA_BATCH_LANES;
+		lane_t accepted = nfa_accept_batch(state->nfa, sample_buffer,
+			state->pending_offset + i, lanes, sample_length);
+		uint8_t l;
+		for (l = 0; l < lanes; l++)
+		{
+			uint32_t offset = state->pending_offset[i + l];
+			uint32_t ordinal = state->pending_ordinal[i + l];
+			uint32_t hits = state->pending_hits[i + l];
+			if (accepted & ((lane_t)1 << l))
+			{
+				if (state->ptrie != NULL) sample_trie_remove(state->ptrie, ordinal);
+				state->rejected[ordinal] = false;
+				continue;
+			}
+			state->pending_offset[kept] = offset;
+			state->pending_ordinal[kept] = ordinal;
+			state->pending_hits[kept] = hits;
+			kept++;
+		}
+	}
+	state->pending = kept;
+
+	// orden por insercion, la lista casi siempre esta ordenada
+	uint32_t p;
+	for (p = 1; p < state->pending; p++)
+	{
+		uint32_t offset = state->pending_offset[p];
+		uint32_t ordinal = state->pending_ordinal[p];
+		uint32_t hits = state->pending_hits[p];
+		uint32_t q = p;
+		while (q > 0 && state->pending_hits[q - 1] < hits)
+		{
+			state->pending_offset[q] = state->pending_offset[q - 1];
+			state->pending_ordinal[q] = state->pending_ordinal[q - 1];
+			state->pending_hits[q] = state->pending_hits[q - 1];
+			q--;
+		}
+		state->pending_offset[q] = offset;
+		state->pending_ordinal[q] = ordinal;
+		state->pending_hits[q] = hits;
+	}
+}
+
+// Calcula de nuevo las tablas de alcanzabilidad de las muestras negativas
+// sobre la hipotesis actual
+void oil_update_reachability(oil_state_t* state,
+	const symbol_t* sample_buffer, const size_t sample_length)
+{
+	if (state->forward == NULL) return;
+	OIL_METRIC(state->metrics, symbol_steps, 2 * (uint64_t)state->negatives * sample_length);
+	const nfa_t* nfa = state->nfa;
+	state->negative_accepted = false;
+	uint32_t n;
+	for (n = 0; n < state->negatives; n++)
+	{
+		const symbol_t* sample = sample_buffer + state->negative_offset[n];
+		bitset_t* f = &state->forward[n * (sample_length + 1)];
+		bitset_t* b = &state->backward[n * (sample_length + 1)];
+		size_t k;
+
+		nfa_get_initials(nfa, &f[0]);
+		state->forward_any[n] = f[0];
+		for (k = 0; k < sample_length; k++)
+		{
+			nfa_step(nfa, &f[k], sample[k], &f[k + 1]);
+			bitset_union(&state->forward_any[n], &f[k + 1]);
+		}
+
+		nfa_get_finals(nfa, &b[sample_length]);
+		state->backward_any[n] = b[sample_length];
+		for (k = sample_length; k > 0; k--)
+		{
+			bitset_clear(&b[k - 1]);
+			bitset_iterator_t j;
+			for (j = bitset_first(&b[k]); !bitset_end(j); j = bitset_next(&b[k], j))
+			{
+				bitset_t tmp;
+				nfa_get_predecessors(nfa, bitset_element(j), sample[k - 1], &tmp);
+				bitset_union(&b[k - 1], &tmp);
+			}
+			bitset_union(&state->backward_any[n], &b[k - 1]);
+		}
+
+		bitset_t accepted = f[0];
+		bitset_intersect(&accepted, &b[0]);
+		if (bitset_any(&accepted)) state->negative_accepted = true;
+	}
+}
+
+// Reserva las tablas de alcanzabilidad de las muestras negativas. Si no hay
+// memoria suficiente las tablas quedan en NULL
+void oil_init_reachability(oil_state_t* state,
+	const symbol_t* sample_buffer, const size_t sample_length,
+	const index_t* nindices, const size_t in_size)
+{
+	state->forward = NULL;
+	state->backward = NULL;
+	state->forward_any = NULL;
+	state->backward_any = NULL;
+	state->negative_offset = NULL;
+	state->negative_order = NULL;
+	state->negative_kills = NULL;
+	state->negatives = 0;
+	state->negative_accepted = false;
+	int t;
+	for (t = 0; t < state->threads; t++)
+	{
+		state->worker[t].kills = NULL;
+	}
+
+	size_t negatives = 0;
+	size_t k;
+	for (k = 0; k < in_size; k++)
+	{
+		negatives += nindices[k].samples;
+	}
+	if (negatives == 0) return;
+	size_t sets = negatives * (sample_length + 1);
+	if (2 * (sets + negatives) * sizeof(bitset_t) > OIL_MAX_REACHABILITY_BYTES) return;
+
+	state->forward = (bitset_t*)malloc(sets * sizeof(bitset_t));
+	state->backward = (bitset_t*)malloc(sets * sizeof(bitset_t));
+	state->forward_any = (bitset_t*)malloc(negatives * sizeof(bitset_t));
+	state->backward_any = (bitset_t*)malloc(negatives * sizeof(bitset_t));
+	state->negative_offset = (uint32_t*)malloc(negatives * sizeof(uint32_t));
+	state->negative_order = (uint32_t*)malloc(negatives * sizeof(uint32_t));
+	state->negative_kills = (uint32_t*)calloc(negatives, sizeof(uint32_t));
+	bool ok = state->forward != NULL && state->backward != NULL &&
+		state->forward_any != NULL && state->backward_any != NULL &&
+		state->negative_offset != NULL && state->negative_order != NULL &&
+		state->negative_kills != NULL;
+	for (t = 0; t < state->threads; t++)
+	{
+		state->worker[t].kills = (uint32_t*)calloc(negatives, sizeof(uint32_t));
+		ok = ok && state->worker[t].kills != NULL;
+	}
+	if (!ok)
+	{
+		oil_free_reachability(state);
+		return;
+	}
+
+	sample_iterator_t i;
+	for (i = sample_iterator_begin(); !sample_iterator_equals(i, sample_iterator_end(in_size));
+		i = sample_iterator_next(nindices, i))
+	{
+		index_t desc = nindices[i.index];
+		state->negative_order[state->negatives] = state->negatives;
+		state->negative_offset[state->negatives++] = desc.begin + desc.stride * i.sample;
+	}
+	oil_update_reachability(state, sample_buffer, sample_length);
+}
+
 // Agrega estados para asegurar que el automata puede reconocer
-// la secuencia suministrada
-void oil_coerce_match_sample(oil_state_t* state, const symbol_t* sample, size_t length)
+// la secuencia suministrada. Retorna false si no quedan suficientes estados
+// libres o espacio para las transiciones, en cuyo caso el automata no se
+// modifica
+bool oil_coerce_match_sample(oil_state_t* state, const symbol_t* sample, size_t length)
 {
-	assert(state->states + length + 1 <= state->pool_size);
+	if (state->states + length + 1 > state->pool_size) return false;
 
 	state->new_states_begin = state->states;
 	state_t* new_state = &state->pool[state->new_states_begin];
@@ -98,7 +611,20 @@ void oil_coerce_match_sample(oil_state_t* state, const symbol_t* sample, size_t
 		bitset_iterator_t j = bitset_next(&state->unused_states, i);
 		bitset_remove_iterator(&state->unused_states, j);		
 		state_t qt = bitset_element(j);
-		nfa_add_transition(state->nfa, qi, qt, *s);
+		if (!nfa_add_transition(state->nfa, qi, qt, *s))
+		{
+			// se deshace la cadena agregada hasta ahora
+			state_t* first = &state->pool[state->new_states_begin];
+			state_t* q;
+			*new_state = qt;
+			for (q = first; q <= new_state; q++)
+			{
+				if (q < new_state) nfa_remove_transition(state->nfa, q[0], q[1], sample[q - first]);
+				bitset_add(&state->unused_states, *q);
+			}
+			nfa_remove_initial(state->nfa, *first);
+			return false;
+		}
 		*new_state++ = qt;
 		i = j; qi = qt;
 	}
@@ -108,8 +634,288 @@ void oil_coerce_match_sample(oil_state_t* state, const symbol_t* sample, size_t
 	
 	state->states += length + 1;
 	assert(nfa_accept_sample(state->nfa, sample, length));
+	return true;
+}
+
+// Evaluacion de las mezclas del estado s1 con los estados pool[0..i)
+typedef struct _oil_merge_task_t
+{
+	oil_state_t* state;
+	const symbol_t* sample_buffer;
+	size_t sample_buffer_size;
+	size_t sample_length;
+	const index_t* pindices;
+	size_t ip_size;
+	const index_t* nindices;
+	size_t in_size;
+	sample_iterator_t next_sample;
+
+	// Posicion de next_sample al recorrer las muestras positivas
+	uint32_t next_ordinal;
+
+	// Estado que se intenta mezclar
+	state_t s1;
+
+	// Cantidad de candidatos
+	int candidates;
+
+	// Siguiente candidato a evaluar, se reparte entre los hilos
+	int next_j;
+
+	// Candidatos evaluados
+	int evaluated;
+
+	// Hilos que no pudieron copiar la hipotesis
+	int failed;
+
+	// Menor candidato valido encontrado, usado con skip_search_best
+	int first_valid;
+
+	// Mejor candidato valido encontrado hasta el momento, codificado con
+	// oil_merge_key. 0 si aun no hay ninguno
+	uint64_t best_key;
+
+	// Puntaje de cada candidato, -1 si no es valido y OIL_PRUNED si se
+	// descarto porque no puede superar al mejor
+	int score[MAX_STATES];
+} oil_merge_task_t;
+
+// Puntaje de un candidato descartado porque no puede ser el mejor
+#define OIL_PRUNED (-2)
+
+// Codifica un candidato valido de manera que el mejor (mayor puntaje y, a
+// igual puntaje, menor indice) tiene la mayor clave
+uint64_t oil_merge_key(int score, int j)
+{
+	return ((uint64_t)score << 32) | (uint32_t)(MAX_STATES - j);
+}
+
+// Puntaje hasta el cual el candidato j puede descartarse sin importar su
+// valor exacto. -1 si no puede descartarse.
+// Un candidato cuyo puntaje no supera al de otro de menor indice nunca es
+// elegido ni impreso como alternativa. Si no se imprimen las alternativas
+// basta con que su puntaje sea menor que el de cualquier otro
+int oil_merge_threshold(const oil_merge_task_t* task, int j)
+{
+	const oil_state_t* state = task->state;
+	if (state->skip_search_best || state->no_prune) return -1;
+	uint64_t key = OIL_LOAD(&task->best_key);
+	if (key == 0) return -1;
+	int best_score = (int)(key >> 32);
+	int best_j = MAX_STATES - (int)(uint32_t)key;
+	if (best_j < j) return best_score;
+	if (!state->print_merge_alternatives) return best_score - 1;
+	return -1;
+}
+
+// Simula un lote de muestras negativas sobre el NFA del hilo. Si el NFA
+// acepta alguna retorna true y cuenta las muestras aceptadas en w->kills
+bool oil_kill_batch(const oil_merge_task_t* task, oil_worker_t* w,
+	const uint32_t* offset, const uint32_t* sample, uint8_t lanes)
+{
+	lane_t accepted = nfa_accept_batch(w->nfa, task->sample_buffer,
+		offset, lanes, task->sample_length);
+	OIL_METRIC(w->metrics, negative_simulations, lanes);
+	OIL_METRIC(w->metrics, symbol_steps, (uint64_t)lanes * task->sample_length);
+	uint8_t l;
+	for (l = 0; l < lanes; l++)
+	{
+		if (accepted & ((lane_t)1 << l)) w->kills[sample[l]]++;
+	}
+	if (accepted != 0) OIL_METRIC(w->metrics, negative_rejections, 1);
+	return accepted != 0;
+}
+
+// Indica si el NFA del hilo, que resulta de mezclar s1 en s2 sobre la
+// hipotesis, acepta alguna muestra negativa.
+// Una muestra que la hipotesis rechaza solo puede ser aceptada por un camino
+// que pasa por el estado mezclado, es decir, si s1 o s2 son alcanzables con
+// algun prefijo y s1 o s2 llevan a un estado final con algun sufijo. Las
+// demas muestras no se simulan. Si un mismo prefijo alcanza s1 y el sufijo
+// que le sigue lleva de s2 a un estado final (o al contrario), la muestra es
+// aceptada sin necesidad de simularla.
+// Las muestras se revisan en el orden de negative_order y la que descarta
+// el candidato se cuenta en w->kills
+bool oil_accept_any_negative(const oil_merge_task_t* task, oil_worker_t* w,
+	state_t s2, state_t s1)
+{
+	const oil_state_t* state = task->state;
+	const nfa_t* nfa = w->nfa;
+	if (state->forward != NULL)
+	{
+		if (state->negative_accepted) return true;
+		size_t positions = task->sample_length + 1;
+		uint32_t offset[NFA_BATCH_LANES];
+		uint32_t sample[NFA_BATCH_LANES];
+		uint8_t lanes = 0;
+		uint32_t p;
+		for (p = 0; p < state->negatives; p++)
+		{
+			uint32_t n = state->negative_order[p];
+			const bitset_t* fa = &state->forward_any[n];
+			const bitset_t* ba = &state->backward_any[n];
+			if (!bitset_contains(fa, s1) && !bitset_contains(fa, s2)) continue;
+			if (!bitset_contains(ba, s1) && !bitset_contains(ba, s2)) continue;
+
+			const bitset_t* f = &state->forward[n * positions];
+			const bitset_t* b = &state->backward[n * positions];
+			size_t k;
+			for (k = 0; k < positions; k++)
+			{
+				if ((bitset_contains(&f[k], s1) && bitset_contains(&b[k], s2)) ||
+					(bitset_contains(&f[k], s2) && bitset_contains(&b[k], s1)))
+				{
+					w->kills[n]++;
+					OIL_METRIC(w->metrics, negative_rejections_table, 1);
+					return true;
+				}
+			}
+
+			sample[lanes] = n;
+			offset[lanes++] = state->negative_offset[n];
+			if (lanes == NFA_BATCH_LANES)
+			{
+				if (oil_kill_batch(task, w, offset, sample, lanes)) return true;
+				lanes = 0;
+			}
+		}
+		return lanes > 0 && oil_kill_batch(task, w, offset, sample, lanes);
+	}
+	if (state->ntrie != NULL)
+	{
+		int c = sample_trie_accept(state->ntrie, nfa, 0, true, true);
+		if (c != -1) return c > 0;
+	}
+	return nfa_accept_any_sample(nfa,
+		task->sample_buffer,
+		task->sample_buffer_size,
+		task->sample_length,
+		task->nindices, // indices
+		task->in_size, // length buffer
+		sample_iterator_begin(), // begin
+		sample_iterator_end(task->in_size) // end
+		);
+}
+
+// Cantidad de muestras positivas a partir de next_sample que el NFA rechaza.
+// Las muestras que la hipotesis ya acepta no se simulan porque el NFA, que
+// resulta de una mezcla sobre la hipotesis, tambien las acepta. Si la
+// cantidad no supera threshold puede retornarse cualquier valor que tampoco
+// lo supere
+int oil_count_rejected_positives(const oil_merge_task_t* task, oil_worker_t* w,
+	int threshold)
+{
+	const oil_state_t* state = task->state;
+	const nfa_t* nfa = w->nfa;
+	if (state->ptrie != NULL)
+	{
+		int c = sample_trie_accept(state->ptrie, nfa, task->next_ordinal, false, false);
+		if (c != -1) return c;
+	}
+	if (state->pending_offset != NULL)
+	{
+		// la muestra actual ya fue retirada, la lista contiene solo muestras
+		// posteriores
+		uint32_t simulated;
+		int c = nfa_accept_offsets_bounded(nfa, task->sample_buffer, task->sample_length,
+			state->pending_offset, state->pending, false, threshold, w->hits, &simulated);
+		OIL_METRIC(w->metrics, positive_simulations, simulated);
+		OIL_METRIC(w->metrics, symbol_steps, (uint64_t)simulated * task->sample_length);
+		return c;
+	}
+	return nfa_accept_samples(nfa,
+		task->sample_buffer,
+		task->sample_buffer_size,
+		task->sample_length,
+		task->pindices, // indices
+		task->ip_size, // index buffer length
+		task->next_sample, // begin
+		sample_iterator_end(task->ip_size)); // end
+}
+
+// Evalua la mezcla de s1 en s2 sobre la copia de la hipotesis del hilo y la
+// deshace. Retorna -1 si el NFA resultante acepta alguna muestra negativa,
+// OIL_PRUNED si su puntaje no supera threshold y de lo contrario el puntaje
+// de la mezcla
+int oil_evaluate_merge(const oil_merge_task_t* task, oil_worker_t* w,
+	state_t s2, state_t s1, int threshold)
+{
+	// el puntaje no puede superar la cantidad de muestras pendientes
+	const oil_state_t* state = task->state;
+	OIL_METRIC(w->metrics, candidates, 1);
+	if (state->pending_offset != NULL && (int)state->pending <= threshold)
+	{
+		OIL_METRIC(w->metrics, candidates_pruned, 1);
+		return OIL_PRUNED;
+	}
+
+	nfa_merge_states_logged(w->nfa, s2, s1, w->log);
+	int score = -1;
+	if (!oil_accept_any_negative(task, w, s2, s1))
+	{
+		score = oil_count_rejected_positives(task, w, threshold);
+		if (score <= threshold)
+		{
+			OIL_METRIC(w->metrics, candidates_pruned, 1);
+			score = OIL_PRUNED;
+		}
+	}
+	nfa_merge_rollback(w->nfa, w->log);
+	return score;
+}
+
+// Tarea de cada hilo: toma candidatos en orden ascendente hasta agotarlos.
+// Con skip_search_best se detiene cuando ya existe un candidato valido
+// menor, de lo contrario descarta los candidatos que no pueden superar al
+// mejor encontrado. En ambos casos el resultado es el mismo que el del ciclo
+// secuencial
+void oil_merge_worker(void* ctx, int worker)
+{
+	oil_merge_task_t* task = (oil_merge_task_t*)ctx;
+	oil_state_t* state = task->state;
+	oil_worker_t* w = &state->worker[worker];
+
+	if (w->nfa != state->nfa && w->version != state->nfa_version)
+	{
+		// sin memoria para la copia el hilo no evalua candidatos, los toman
+		// los demas hilos
+		if (!nfa_clone(w->nfa, state->nfa))
+		{
+			OIL_FETCH_ADD(&task->failed, 1);
+			return;
+		}
+		w->version = state->nfa_version;
+	}
+
+	for (;;)
+	{
+		int j = OIL_FETCH_ADD(&task->next_j, 1);
+		if (j >= task->candidates) break;
+		if (state->skip_search_best && j > OIL_LOAD(&task->first_valid)) break;
+
+		int score = oil_evaluate_merge(task, w,
+			state->pool[j], task->s1, oil_merge_threshold(task, j));
+		task->score[j] = score;
+		OIL_FETCH_ADD(&task->evaluated, 1);
+
+		if (score >= 0 && state->skip_search_best)
+		{
+			int expected = OIL_LOAD(&task->first_valid);
+			while (j < expected && !OIL_CAS(&task->first_valid, &expected, j));
+		}
+		else if (score >= 0)
+		{
+			uint64_t key = oil_merge_key(score, j);
+			uint64_t expected = OIL_LOAD(&task->best_key);
+			while (key > expected && !OIL_CAS(&task->best_key, &expected, key));
+		}
+	}
 }
 
+#ifdef OIL_THREADS
+void oil_stop_workers(oil_state_t* state);
+#endif
+
 // Realiza todas las mezclas de estados que sean posibles. 
 // Solo se considera posible una mezcla de estados donde el NFA resultante 
 // reconoce las mismas muestras positivas tenidas en cuenta hasta el momento y
@@ -123,51 +929,87 @@ void oil_do_all_merges(oil_state_t* state,
 	)
 {
 	sample_iterator_t next_sample = sample_iterator_next(pindices, state->current_sample);
+	// la hipotesis cambio al forzar la muestra actual
+	state->nfa_version++;
+	oil_compact_pending(state, sample_buffer, sample_length);
+	oil_update_reachability(state, sample_buffer, sample_length);
 	if (!state->no_random_sort)
 	{
 		state_t begin = state->new_states_begin;
 		state_t len = state->states - begin;
-		oil_random_shuffle(state->pool + begin, len);
+		oil_random_shuffle(state, state->pool + begin, len);
 	}
+	oil_merge_task_t task;
+	task.state = state;
+	task.sample_buffer = sample_buffer;
+	task.sample_buffer_size = sample_buffer_size;
+	task.sample_length = sample_length;
+	task.pindices = pindices;
+	task.ip_size = ip_size;
+	task.nindices = nindices;
+	task.in_size = in_size;
+	task.next_sample = next_sample;
+	task.next_ordinal = state->current_ordinal + 1;
+
+	// Cada par candidato (pool[j], pool[i]) incluye un estado agregado al
+	// forzar la muestra actual, que no existia en iteraciones anteriores, y
+	// tras una mezcla pool[i] pasa a ser otro estado nuevo. Por eso un par
+	// nunca se evalua dos veces y no vale la pena recordar los pares invalidos
 	state_t i;
 	for (i = state->new_states_begin; i < state->states;)
 	{
 		int best_score = -1;
 		int best_j = -1;
 		state_t s1 = state->pool[i];
-		nfa_t best_nfa;
 		state_t j;
+
+		task.s1 = s1;
+		task.candidates = i;
+		task.next_j = 0;
+		task.evaluated = 0;
+		task.first_valid = i;
+		task.best_key = 0;
+		task.failed = 0;
+		for (j = 0; j < i; j++)
+		{
+			task.score[j] = -1;
+		}
+		OIL_METRIC_START(state->metrics, evaluate_start);
+#ifdef OIL_THREADS
+		if (state->threads > 1)
+		{
+			workers_run(&state->workers, oil_merge_worker, &task);
+			// si ningun hilo pudo copiar la hipotesis se continua con uno
+			// solo, que evalua sobre ella sin copiarla
+			if (task.failed == state->threads)
+			{
+				oil_stop_workers(state);
+				oil_merge_worker(&task, 0);
+			}
+		}
+		else
+#endif
+		{
+			oil_merge_worker(&task, 0);
+		}
+		state->merge_attempts += task.evaluated;
+		oil_gather_hits(state);
+		oil_gather_kills(state);
+		oil_gather_metrics(state);
+		OIL_METRIC_ELAPSED(state->metrics, evaluate_ns, evaluate_start);
+
+		// la reduccion se hace en orden para que el resultado no dependa
+		// de la cantidad de hilos
 		for (j = 0; j < i; j++)
 		{
 			state_t s2 = state->pool[j];
-			nfa_t lnfa;
-			nfa_clone(&lnfa, state->nfa);
-			nfa_merge_states(&lnfa, s2, s1);
-			bool anyNegMatch = nfa_accept_any_sample(&lnfa,
-				sample_buffer,
-				sample_buffer_size,
-				sample_length,
-				nindices, // indices
-				in_size, // length buffer
-				sample_iterator_begin(), // begin
-				sample_iterator_end(in_size) // end
-				);
-			if (anyNegMatch) continue;
-
-			int score = nfa_accept_samples(&lnfa,
-				sample_buffer,
-				sample_buffer_size,
-				sample_length,
-				pindices, // indices
-				ip_size, // index buffer length
-				next_sample, // begin
-				sample_iterator_end(ip_size)); // end
+			int score = task.score[j];
+			if (score < 0) continue;
 
 			if (score > best_score)
 			{
 				best_score = score;
 				best_j = j;
-				nfa_clone(&best_nfa, &lnfa);
 				if (state->skip_search_best) break;
 				if (state->print_merge_alternatives)
 				{
@@ -181,7 +1023,15 @@ void oil_do_all_merges(oil_state_t* state,
 		// eliminamos el estado eliminado del vector de estados aleatorio
 		if (best_score != -1)
 		{
+			// se aplica de nuevo la mejor mezcla, esta vez de manera definitiva
+			OIL_METRIC_START(state->metrics, commit_start);
+			nfa_merge_states(state->nfa, state->pool[best_j], s1);
+			state->nfa_version++;
 			state->merge_counter++;
+			oil_compact_pending(state, sample_buffer, sample_length);
+			oil_update_reachability(state, sample_buffer, sample_length);
+			OIL_METRIC(state->metrics, merges, 1);
+			OIL_METRIC_ELAPSED(state->metrics, commit_ns, commit_start);
 			bitset_add(&state->unused_states, state->pool[i]);
 			if (state->print_merges)
 			{
@@ -191,14 +1041,13 @@ void oil_do_all_merges(oil_state_t* state,
 			if (state->no_random_sort)
 			{
 				memmove(state->pool + i, state->pool + i + 1,
-					state->states - state->new_states_begin);
+					(state->states - i - 1) * sizeof(state_t));
 			}
 			else
 			{
 				state->pool[i] = state->pool[state->states - 1];
 			}
 			state->states--;
-			nfa_clone(state->nfa, &best_nfa);
 		}
 		else
 		{
@@ -216,78 +1065,1378 @@ void oil_do_all_merges(oil_state_t* state,
 		sample_iterator_begin(), next_sample));
 }
 
-// Algoritmo que obtiene un automata NFA que puede reconocer un conjunto de
-// secuencias y rechazar otro.
-void oil(const symbol_t* sample_buffer,
-	const size_t sample_buffer_size,
-	const size_t sample_length,
-	const symbol_t symbols,
-	const index_t* pindices, const size_t ip_size,
-	const index_t* nindices, const size_t in_size,
-	nfa_t* nfa
-	)
+#ifdef OIL_THREADS
+// Libera las copias de la hipotesis de cada hilo y vuelve a un solo hilo
+void oil_release_workers(oil_state_t* state)
 {
-	oil_state_t state;
-	state.nfa = nfa;
-	state.pool_size = MAX_STATES;
-	state.states = 0;
-	state.no_random_sort = false;
-	state.skip_search_best = false;
-	state.new_states_begin = 0;
-	state.merge_counter = 0;
+	int t;
+	for (t = 0; t < state->threads; t++)
+	{
+		if (state->worker[t].nfa != NULL) nfa_free(state->worker[t].nfa);
+		free(state->worker[t].nfa);
+		if (state->worker[t].log != NULL) nfa_merge_log_free(state->worker[t].log);
+		free(state->worker[t].log);
+	}
+	state->threads = 1;
+	state->worker[0].nfa = state->nfa;
+	state->worker[0].log = &state->merge_log;
+	state->worker[0].version = state->nfa_version;
+}
 
-	// print debug info
-	state.print_merges = true;
-	state.print_progress = true;
-	state.print_merge_alternatives = true;
+// Crea los hilos y la copia de la hipotesis que usa cada uno. Si no es
+// posible se continua con un solo hilo
+void oil_start_workers(oil_state_t* state, int threads, const symbol_t symbols)
+{
+	if (threads > OIL_MAX_THREADS) threads = OIL_MAX_THREADS;
+	if (threads > MAX_WORKERS) threads = MAX_WORKERS;
 
-	// inicializa los estados no usados
-	bitset_init(&state.unused_states);
-	bitset_add_range(&state.unused_states, 0, MAX_STATES);
-	
-	nfa_init(nfa, symbols);
+	bool ok = true;
+	int t;
+	for (t = 0; t < threads; t++)
+	{
+		oil_worker_t* w = &state->worker[t];
+		w->nfa = (nfa_t*)malloc(sizeof(nfa_t));
+		if (w->nfa != NULL) nfa_init(w->nfa, symbols);
+		w->log = (nfa_merge_log_t*)malloc(sizeof(nfa_merge_log_t));
+		w->version = state->nfa_version - 1;
+		if (w->log != NULL && !nfa_merge_log_init(w->log, symbols)) ok = false;
+		ok = ok && w->nfa != NULL && w->log != NULL;
+	}
+	state->threads = threads;
+	if (ok)
+	{
+		if (workers_init(&state->workers, threads)) return;
+		workers_destroy(&state->workers);
+	}
+	oil_release_workers(state);
+}
+
+// Termina los hilos creados por oil_start_workers
+void oil_stop_workers(oil_state_t* state)
+{
+	if (state->threads == 1) return;
+	workers_destroy(&state->workers);
+	oil_release_workers(state);
+}
+#endif
+
+// Formato del archivo de checkpoint. "OILC" leido como entero en el orden de
+// bytes de la maquina; un archivo de otra maquina no se reconoce
+#define OIL_CHECKPOINT_MAGIC 0x434C494Fu
+#define OIL_CHECKPOINT_VERSION 1u
 
-	int total_samples;
-	int current_sample;
-	if(state.print_progress)
+// Encabezado del checkpoint. Le siguen, en este orden:
+// - unused_states y los estados iniciales y finales, cada uno como bitset_t
+// - el vector de estados aleatorio, states valores uint16_t
+// - las transiciones, edges pares uint32_t: (origen << 8) | simbolo, destino
+// - si pending no es UINT32_MAX, la lista de muestras pendientes: pending
+//   posiciones, pending ordinales y pending contadores uint32_t
+// - si kills no es cero, el orden y los contadores de las muestras
+//   negativas, kills uint32_t cada uno
+// Las tablas de alcanzabilidad se calculan de nuevo al reanudar
+typedef struct _oil_checkpoint_header_t
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;
+	// Identifican la ejecucion, solo se reanuda si coinciden
+	uint32_t max_states;
+	uint16_t symbols;
+	uint8_t no_random_sort;
+	uint8_t skip_search_best;
+	uint64_t seed;
+	uint64_t samples_hash;
+	uint32_t sample_length;
+	uint32_t positives;
+	uint32_t negatives;
+	// Ordinal de la proxima muestra positiva a procesar
+	uint32_t ordinal;
+	// Muestras positivas forzadas hasta el momento
+	uint32_t coerced;
+	uint32_t states;
+	int32_t merge_counter;
+	uint32_t edges;
+	uint32_t pending;
+	uint32_t kills;
+	uint64_t merge_attempts;
+	uint64_t rng;
+	// Tamano total del archivo en bytes
+	uint64_t size;
+} oil_checkpoint_header_t;
+
+// Dispersion FNV-1a de las muestras, para reconocer un checkpoint de otro
+// conjunto de muestras
+uint64_t oil_samples_hash(uint64_t h, const symbol_t* sample_buffer, const size_t sample_length,
+	const index_t* indices, const size_t i_size)
+{
+	sample_iterator_t i;
+	for (i = sample_iterator_begin(); !sample_iterator_equals(i, sample_iterator_end(i_size));
+		i = sample_iterator_next(indices, i))
 	{
-		total_samples = 0;
-		current_sample = 0;
-		for(uint16_t i=0; i<ip_size; i++)
+		const symbol_t* sample = sample_buffer + indices[i.index].begin +
+			indices[i.index].stride * i.sample;
+		size_t k;
+		for (k = 0; k < sample_length; k++)
 		{
-			total_samples += pindices[i].samples;
+			h = (h ^ sample[k]) * 0x100000001B3ull;
 		}
-		printf("%d total positive samples\n", total_samples);
-		printf("oil start. sample_length: %llu. ip_size: %llu, in_size: %llu, symbols: %hhu\n",
-			sample_length, ip_size, in_size, symbols);
 	}
+	return h;
+}
 
-	// ciclo para cada una de las muestras positivas
-	for (state.current_sample = sample_iterator_begin();
-		!sample_iterator_equals(state.current_sample, sample_iterator_end(ip_size));
-		state.current_sample = sample_iterator_next(pindices, state.current_sample))
-	{
-		index_t desc = pindices[state.current_sample.index];
-		uint32_t offset = desc.begin + state.current_sample.sample * desc.stride;
-		if (!nfa_accept_sample(nfa, &sample_buffer[offset], sample_length))
-		{
-			oil_coerce_match_sample(&state, &sample_buffer[offset], sample_length);
-			oil_do_all_merges(&state,
-				sample_buffer,
-				sample_buffer_size,
-				sample_length,
-				pindices, ip_size,
-				nindices, in_size
-				);
-			if (state.print_progress)
-			{
-				current_sample++;
-				printf("progress: %0.1f%% sample: %llu/%llu [states: %u]\n",
-					(current_sample*100.0f/total_samples),
-					current_sample, total_samples,
-					state.states);
-			}
-		}
+// Prepara los campos que identifican la ejecucion
+void oil_checkpoint_init(oil_checkpoint_header_t* h, const oil_config_t* config,
+	const symbol_t* sample_buffer, const size_t sample_length, const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size)
+{
+	memset(h, 0, sizeof(oil_checkpoint_header_t));
+	h->magic = OIL_CHECKPOINT_MAGIC;
+	h->version = OIL_CHECKPOINT_VERSION;
+	h->header_size = sizeof(oil_checkpoint_header_t);
+	h->max_states = MAX_STATES;
+	h->symbols = symbols;
+	h->no_random_sort = config->no_random_sort;
+	h->skip_search_best = config->skip_search_best;
+	h->seed = config->seed;
+	h->sample_length = (uint32_t)sample_length;
+	size_t k;
+	for (k = 0; k < ip_size; k++)
+	{
+		h->positives += pindices[k].samples;
+	}
+	for (k = 0; k < in_size; k++)
+	{
+		h->negatives += nindices[k].samples;
+	}
+	// se separan las positivas de las negativas para que cambiar una
+	// muestra de clase cambie la dispersion
+	h->samples_hash = oil_samples_hash(0xCBF29CE484222325ull,
+		sample_buffer, sample_length, pindices, ip_size);
+	h->samples_hash = oil_samples_hash(h->samples_hash * 0x100000001B3ull,
+		sample_buffer, sample_length, nindices, in_size);
+}
+
+// Tamano del archivo segun las cantidades del encabezado
+uint64_t oil_checkpoint_size(const oil_checkpoint_header_t* h)
+{
+	uint64_t size = sizeof(oil_checkpoint_header_t) + 3 * sizeof(bitset_t) +
+		(uint64_t)h->states * sizeof(uint16_t) + (uint64_t)h->edges * 2 * sizeof(uint32_t);
+	if (h->pending != UINT32_MAX) size += (uint64_t)h->pending * 3 * sizeof(uint32_t);
+	return size + (uint64_t)h->kills * 2 * sizeof(uint32_t);
+}
+
+// Escribe count bytes, nada si count es cero
+bool oil_checkpoint_write(FILE* out, const void* data, size_t count)
+{
+	return count == 0 || fwrite(data, count, 1, out) == 1;
+}
+
+// Lee count bytes, nada si count es cero
+bool oil_checkpoint_read(FILE* in, void* data, size_t count)
+{
+	return count == 0 || fread(data, count, 1, in) == 1;
+}
+
+// Guarda el estado del aprendizaje en path. ordinal es la proxima muestra
+// positiva a procesar. El archivo se escribe en path.tmp y se renombra al
+// terminar, de manera que una interrupcion conserva el checkpoint anterior
+bool oil_checkpoint_save(const oil_state_t* state, const char* path,
+	const oil_checkpoint_header_t* base, uint32_t ordinal)
+{
+	const nfa_t* nfa = state->nfa;
+	symbol_t symbols = nfa_get_symbols(nfa);
+	oil_checkpoint_header_t h = *base;
+	h.ordinal = ordinal;
+	h.coerced = state->coerced;
+	h.states = state->states;
+	h.merge_counter = state->merge_counter;
+	h.merge_attempts = state->merge_attempts;
+	h.rng = state->rng;
+	h.pending = state->pending_offset != NULL ? state->pending : UINT32_MAX;
+	h.kills = state->forward != NULL ? state->negatives : 0;
+
+	// se cuentan las transiciones antes de reservar la lista
+	bitset_t succ;
+	state_t q;
+	symbol_t a;
+	bitset_iterator_t j;
+	for (q = 0; q < MAX_STATES; q++)
+	{
+		for (a = 0; a < symbols; a++)
+		{
+			nfa_get_sucessors(nfa, q, a, &succ);
+			for (j = bitset_first(&succ); !bitset_end(j); j = bitset_next(&succ, j))
+			{
+				h.edges++;
+			}
+		}
+	}
+	h.size = oil_checkpoint_size(&h);
+
+	uint32_t* edge = (uint32_t*)malloc(((size_t)h.edges * 2 + 1) * sizeof(uint32_t));
+	char* tmp = (char*)malloc(strlen(path) + 5);
+	bool ok = edge != NULL && tmp != NULL;
+	uint32_t e = 0;
+	for (q = 0; ok && q < MAX_STATES; q++)
+	{
+		for (a = 0; a < symbols; a++)
+		{
+			nfa_get_sucessors(nfa, q, a, &succ);
+			for (j = bitset_first(&succ); !bitset_end(j); j = bitset_next(&succ, j))
+			{
+				edge[e++] = (uint32_t)q << 8 | a;
+				edge[e++] = bitset_element(j);
+			}
+		}
+	}
+	uint16_t pool[MAX_STATES];
+	for (q = 0; q < state->states; q++)
+	{
+		pool[q] = state->pool[q];
+	}
+	bitset_t initials;
+	bitset_t finals;
+	nfa_get_initials(nfa, &initials);
+	nfa_get_finals(nfa, &finals);
+
+	FILE* out = NULL;
+	if (ok)
+	{
+		sprintf(tmp, "%s.tmp", path);
+		out = fopen(tmp, "wb");
+		ok = out != NULL;
+	}
+	ok = ok && oil_checkpoint_write(out, &h, sizeof(h));
+	ok = ok && oil_checkpoint_write(out, &state->unused_states, sizeof(bitset_t));
+	ok = ok && oil_checkpoint_write(out, &initials, sizeof(bitset_t));
+	ok = ok && oil_checkpoint_write(out, &finals, sizeof(bitset_t));
+	ok = ok && oil_checkpoint_write(out, pool, h.states * sizeof(uint16_t));
+	ok = ok && oil_checkpoint_write(out, edge, (size_t)h.edges * 2 * sizeof(uint32_t));
+	if (h.pending != UINT32_MAX)
+	{
+		ok = ok && oil_checkpoint_write(out, state->pending_offset, h.pending * sizeof(uint32_t));
+		ok = ok && oil_checkpoint_write(out, state->pending_ordinal, h.pending * sizeof(uint32_t));
+		ok = ok && oil_checkpoint_write(out, state->pending_hits, h.pending * sizeof(uint32_t));
+	}
+	ok = ok && oil_checkpoint_write(out, state->negative_order, h.kills * sizeof(uint32_t));
+	ok = ok && oil_checkpoint_write(out, state->negative_kills, h.kills * sizeof(uint32_t));
+	// el contenido debe llegar al disco antes de reemplazar el anterior
+	ok = ok && fflush(out) == 0 && fsync(fileno(out)) == 0;
+	if (out != NULL && fclose(out) != 0) ok = false;
+	if (out != NULL)
+	{
+		if (ok) ok = rename(tmp, path) == 0;
+		if (!ok) remove(tmp);
+	}
+	free(edge);
+	free(tmp);
+	return ok;
+}
+
+// Restaura el estado del aprendizaje desde el checkpoint. La hipotesis, las
+// listas y las tablas ya deben estar inicializadas para una ejecucion
+// nueva. Retorna false si el archivo no es valido o no corresponde a base,
+// en cuyo caso el estado queda a medias
+bool oil_checkpoint_load(oil_state_t* state, FILE* in, const oil_checkpoint_header_t* base,
+	const size_t sample_buffer_size, const symbol_t* sample_buffer, const size_t sample_length,
+	uint32_t* ordinal)
+{
+	oil_checkpoint_header_t h;
+	if (!oil_checkpoint_read(in, &h, sizeof(h))) return false;
+	long size = fseek(in, 0, SEEK_END) == 0 ? ftell(in) : -1;
+	if (size < 0 || fseek(in, sizeof(h), SEEK_SET) != 0) return false;
+	if (h.magic != base->magic || h.version != base->version ||
+		h.header_size != base->header_size || h.max_states != base->max_states ||
+		h.symbols != base->symbols || h.no_random_sort != base->no_random_sort ||
+		h.skip_search_best != base->skip_search_best || h.seed != base->seed ||
+		h.samples_hash != base->samples_hash || h.sample_length != base->sample_length ||
+		h.positives != base->positives || h.negatives != base->negatives)
+	{
+		return false;
+	}
+	if (h.ordinal > h.positives || h.states > MAX_STATES ||
+		(h.pending != UINT32_MAX && h.pending > h.positives) ||
+		(h.kills != 0 && h.kills != h.negatives) || h.size != oil_checkpoint_size(&h) ||
+		h.size != (uint64_t)size)
+	{
+		return false;
+	}
+
+	// estados y transiciones, todos deben existir en este NFA
+	nfa_t* nfa = state->nfa;
+	bitset_t initials;
+	bitset_t finals;
+	uint16_t pool[MAX_STATES];
+	bool ok = oil_checkpoint_read(in, &state->unused_states, sizeof(bitset_t)) &&
+		oil_checkpoint_read(in, &initials, sizeof(bitset_t)) &&
+		oil_checkpoint_read(in, &finals, sizeof(bitset_t)) &&
+		oil_checkpoint_read(in, pool, h.states * sizeof(uint16_t));
+	if (!ok || bitset_contains(&state->unused_states, MAX_STATES) ||
+		bitset_contains(&initials, MAX_STATES) || bitset_contains(&finals, MAX_STATES))
+	{
+		return false;
+	}
+	state_t q;
+	for (q = 0; q < h.states; q++)
+	{
+		if (pool[q] >= MAX_STATES) return false;
+		state->pool[q] = pool[q];
+	}
+	bitset_iterator_t j;
+	for (j = bitset_first(&initials); !bitset_end(j); j = bitset_next(&initials, j))
+	{
+		nfa_add_initial(nfa, bitset_element(j));
+	}
+	for (j = bitset_first(&finals); !bitset_end(j); j = bitset_next(&finals, j))
+	{
+		nfa_add_final(nfa, bitset_element(j));
+	}
+	uint32_t edge[512];
+	uint32_t e;
+	for (e = 0; e < h.edges; e += 256)
+	{
+		uint32_t count = h.edges - e < 256 ? h.edges - e : 256;
+		if (!oil_checkpoint_read(in, edge, count * 2 * sizeof(uint32_t))) return false;
+		uint32_t k;
+		for (k = 0; k < count; k++)
+		{
+			uint32_t from = edge[2 * k] >> 8;
+			symbol_t a = edge[2 * k] & 0xFF;
+			if (from >= MAX_STATES || a >= h.symbols || edge[2 * k + 1] >= MAX_STATES) return false;
+			if (!nfa_add_transition(nfa, from, edge[2 * k + 1], a)) return false;
+		}
+	}
+
+	// lista de muestras pendientes, cada ordinal a lo sumo una vez
+	if (h.pending != UINT32_MAX && state->pending_offset != NULL)
+	{
+		ok = oil_checkpoint_read(in, state->pending_offset, h.pending * sizeof(uint32_t)) &&
+			oil_checkpoint_read(in, state->pending_ordinal, h.pending * sizeof(uint32_t)) &&
+			oil_checkpoint_read(in, state->pending_hits, h.pending * sizeof(uint32_t));
+		if (!ok) return false;
+		memset(state->rejected, 0, h.positives * sizeof(bool));
+		uint32_t p;
+		for (p = 0; p < h.pending; p++)
+		{
+			uint32_t o = state->pending_ordinal[p];
+			if (o >= h.positives || state->rejected[o] ||
+				state->pending_offset[p] + sample_length > sample_buffer_size)
+			{
+				return false;
+			}
+			state->rejected[o] = true;
+		}
+		state->pending = h.pending;
+		for (p = 0; p < h.positives; p++)
+		{
+			if (!state->rejected[p] && state->ptrie != NULL) sample_trie_remove(state->ptrie, p);
+		}
+	}
+	else
+	{
+		if (h.pending != UINT32_MAX &&
+			fseek(in, (long)h.pending * 3 * sizeof(uint32_t), SEEK_CUR) != 0)
+		{
+			return false;
+		}
+		// la lista se calcula de nuevo sobre la hipotesis restaurada
+		oil_compact_pending(state, sample_buffer, sample_length);
+	}
+
+	// orden de las muestras negativas, debe ser una permutacion
+	if (h.kills != 0 && state->forward != NULL)
+	{
+		ok = oil_checkpoint_read(in, state->negative_order, h.kills * sizeof(uint32_t)) &&
+			oil_checkpoint_read(in, state->negative_kills, h.kills * sizeof(uint32_t));
+		bool* seen = (bool*)calloc(h.kills, sizeof(bool));
+		ok = ok && seen != NULL;
+		uint32_t n;
+		for (n = 0; ok && n < h.kills; n++)
+		{
+			uint32_t o = state->negative_order[n];
+			ok = o < h.kills && !seen[o];
+			if (ok) seen[o] = true;
+		}
+		free(seen);
+		if (!ok) return false;
+	}
+	else if (h.kills != 0 && fseek(in, (long)h.kills * 2 * sizeof(uint32_t), SEEK_CUR) != 0)
+	{
+		return false;
+	}
+
+	state->states = h.states;
+	state->coerced = h.coerced;
+	state->merge_counter = h.merge_counter;
+	state->merge_attempts = h.merge_attempts;
+	state->rng = h.rng;
+	state->nfa_version++;
+	oil_update_reachability(state, sample_buffer, sample_length);
+	*ordinal = h.ordinal;
+	return true;
+}
+
+// Prepara el estado para aprender con la configuracion suministrada: crea
+// los hilos, inicializa los contadores y deja la hipotesis vacia. Retorna
+// false si no hay memoria para el registro de mezclas, en tal caso la
+// hipotesis queda vacia y no se debe llamar oil_state_free
+bool oil_state_init(oil_state_t* state, const oil_config_t* config,
+	const symbol_t symbols, nfa_t* nfa)
+{
+	if (!nfa_merge_log_init(&state->merge_log, symbols))
+	{
+		nfa_init(nfa, symbols);
+		return false;
+	}
+
+	state->nfa = nfa;
+	state->pool_size = MAX_STATES;
+	state->states = 0;
+	state->no_random_sort = config->no_random_sort;
+	state->skip_search_best = config->skip_search_best;
+	state->no_prune = config->no_prune;
+	state->no_kill_order = config->no_kill_order;
+	state->rng = config->seed;
+	state->new_states_begin = 0;
+	state->merge_counter = 0;
+	state->merge_attempts = 0;
+	state->coerced = 0;
+	state->checkpoints = 0;
+	state->ptrie = NULL;
+	state->ntrie = NULL;
+	state->pending_offset = NULL;
+	state->pending_ordinal = NULL;
+	state->pending_hits = NULL;
+	state->rejected = NULL;
+	state->forward = NULL;
+	state->backward = NULL;
+	state->forward_any = NULL;
+	state->backward_any = NULL;
+	state->negative_offset = NULL;
+	state->negative_order = NULL;
+	state->negative_kills = NULL;
+
+	// el hilo 0 evalua directamente sobre la hipotesis
+	state->threads = 1;
+	state->nfa_version = 0;
+	state->worker[0].nfa = nfa;
+	state->worker[0].log = &state->merge_log;
+	state->worker[0].version = 0;
+#ifdef OIL_THREADS
+	if (config->threads > 1)
+	{
+		oil_start_workers(state, config->threads, symbols);
+	}
+#endif
+
+	// contadores, cada hilo acumula en los suyos
+#ifdef OIL_METRICS
+	state->metrics = config->metrics;
+#else
+	state->metrics = NULL;
+#endif
+	for (int t = 0; t < state->threads; t++)
+	{
+		state->worker[t].hits = NULL;
+		state->worker[t].kills = NULL;
+		oil_metrics_init(&state->worker[t].local_metrics);
+		state->worker[t].metrics = state->metrics != NULL ?
+			&state->worker[t].local_metrics : NULL;
+	}
+
+	// print debug info
+	state->print_merges = config->print_merges;
+	state->print_progress = config->print_progress;
+	state->print_merge_alternatives = config->print_merge_alternatives;
+
+	// inicializa los estados no usados
+	bitset_init(&state->unused_states);
+	bitset_add_range(&state->unused_states, 0, MAX_STATES);
+
+	nfa_init(nfa, symbols);
+	nfa_set_symbol_major(nfa, config->symbol_major);
+	return true;
+}
+
+// Construye los indices de prefijos de las muestras, si no hay memoria se
+// simula cada muestra
+void oil_init_tries(oil_state_t* state,
+	const symbol_t* sample_buffer, const size_t sample_length,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size)
+{
+	state->ptrie = NULL;
+	state->ntrie = NULL;
+	if (sample_trie_build(&state->ptrie_storage, sample_buffer, sample_length,
+		pindices, ip_size))
+	{
+		state->ptrie = &state->ptrie_storage;
+	}
+	if (sample_trie_build(&state->ntrie_storage, sample_buffer, sample_length,
+		nindices, in_size))
+	{
+		state->ntrie = &state->ntrie_storage;
 	}
 }
 
+// Libera los indices de prefijos
+void oil_free_tries(oil_state_t* state)
+{
+	if (state->ptrie != NULL) sample_trie_free(state->ptrie);
+	if (state->ntrie != NULL) sample_trie_free(state->ntrie);
+	state->ptrie = NULL;
+	state->ntrie = NULL;
+}
+
+// Libera las listas, las tablas, los indices de prefijos y los hilos
+void oil_state_free(oil_state_t* state)
+{
+	oil_free_pending(state);
+	oil_free_reachability(state);
+#ifdef OIL_THREADS
+	oil_stop_workers(state);
+#endif
+	oil_free_tries(state);
+	nfa_merge_log_free(&state->merge_log);
+}
+
+// Procesa las muestras positivas desde begin, cuyo ordinal es
+// begin_ordinal: fuerza las que la hipotesis rechaza y mezcla estados. Si
+// checkpoint no es NULL guarda checkpoints segun la configuracion. Retorna
+// false si se supera MAX_STATES o se cancela la ejecucion
+bool oil_learn(oil_state_t* state, const oil_config_t* config,
+	const oil_checkpoint_header_t* checkpoint,
+	const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const size_t sample_length,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	sample_iterator_t begin, uint32_t begin_ordinal, uint32_t total_samples)
+{
+	const nfa_t* nfa = state->nfa;
+
+	// ciclo para cada una de las muestras positivas
+	for (state->current_sample = begin, state->current_ordinal = begin_ordinal;
+		!sample_iterator_equals(state->current_sample, sample_iterator_end(ip_size));
+		state->current_sample = sample_iterator_next(pindices, state->current_sample),
+		state->current_ordinal++)
+	{
+		index_t desc = pindices[state->current_sample.index];
+		uint32_t offset = desc.begin + state->current_sample.sample * desc.stride;
+		bool rejected;
+		if (state->pending_offset != NULL)
+		{
+			// la lista esta al dia, la muestra es rechazada si sigue en ella
+			rejected = state->rejected[state->current_ordinal];
+			assert(rejected == !nfa_accept_sample(nfa, &sample_buffer[offset], sample_length));
+		}
+		else
+		{
+			rejected = !nfa_accept_sample(nfa, &sample_buffer[offset], sample_length);
+		}
+		if (!rejected) continue;
+
+		OIL_METRIC_START(state->metrics, coerce_start);
+		bool coerced = oil_coerce_match_sample(state, &sample_buffer[offset], sample_length);
+		OIL_METRIC_ELAPSED(state->metrics, coerce_ns, coerce_start);
+		OIL_METRIC(state->metrics, samples_coerced, 1);
+		if (!coerced)
+		{
+			if (state->print_progress)
+			{
+				printf("oil stop: MAX_STATES (%u) or MAX_SPARSE_EDGES exceeded, "
+					"use a larger BITSET_BITS\n", MAX_STATES);
+			}
+			return false;
+		}
+		oil_do_all_merges(state,
+			sample_buffer,
+			sample_buffer_size,
+			sample_length,
+			pindices, ip_size,
+			nindices, in_size
+			);
+		state->coerced++;
+		if (state->print_progress)
+		{
+			printf("progress: %0.1f%% sample: %u/%u [states: %u]\n",
+				(state->coerced*100.0f/total_samples),
+				state->coerced, total_samples,
+				state->states);
+		}
+		if (state->metrics != NULL && config->metrics_callback != NULL)
+		{
+			config->metrics_callback(state->metrics, config->metrics_user);
+		}
+		if (checkpoint != NULL && config->checkpoint_interval > 0 &&
+			state->coerced % config->checkpoint_interval == 0)
+		{
+			if (oil_checkpoint_save(state, config->checkpoint_path, checkpoint,
+				state->current_ordinal + 1))
+			{
+				state->checkpoints++;
+			}
+			else if (state->print_progress)
+			{
+				printf("oil: could not write checkpoint %s\n", config->checkpoint_path);
+			}
+		}
+		if (config->cancel_states != NULL &&
+			state->states > OIL_LOAD(config->cancel_states))
+		{
+			if (state->print_progress)
+			{
+				printf("oil stop: cancelled [states: %u]\n", state->states);
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+// Inicializa la configuracion con los valores por defecto
+void oil_config_init(oil_config_t* config)
+{
+	config->no_random_sort = false;
+	config->skip_search_best = false;
+	config->no_prune = false;
+	config->no_kill_order = false;
+	config->threads = 1;
+	config->use_trie = false;
+	config->reduce = false;
+	config->compact_alphabet = false;
+	config->symbol_major = false;
+	config->print_merge_alternatives = false;
+	config->print_merges = false;
+	config->print_progress = false;
+	config->stats = NULL;
+	config->seed = 1;
+	config->cancel_states = NULL;
+	config->metrics = NULL;
+	config->metrics_callback = NULL;
+	config->metrics_user = NULL;
+	config->checkpoint_path = NULL;
+	config->checkpoint_interval = 1;
+	config->resume = false;
+}
+
+// Algoritmo que obtiene un automata NFA que puede reconocer un conjunto de
+// secuencias y rechazar otro.
+bool oil(const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const size_t sample_length,
+	const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	nfa_t* nfa
+	)
+{
+	oil_config_t config;
+	oil_config_init(&config);
+	return oil_ex(sample_buffer, sample_buffer_size, sample_length, symbols,
+		pindices, ip_size, nindices, in_size, &config, nfa);
+}
+
+// Ejecuta oil_ex sobre las muestras traducidas al alfabeto compacto y
+// traduce el NFA aprendido al alfabeto original. Si no hay memoria para la
+// copia de las muestras se aprende sobre el alfabeto original
+bool oil_ex_compact(const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const size_t sample_length,
+	const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	const oil_config_t* config,
+	nfa_t* nfa
+	)
+{
+	oil_config_t compact = *config;
+	compact.compact_alphabet = false;
+	alphabet_t alphabet;
+	alphabet_from_samples(&alphabet, symbols, sample_buffer, sample_length,
+		pindices, ip_size, nindices, in_size);
+	symbol_t* buffer = NULL;
+	nfa_t* learned = NULL;
+	if (alphabet.classes > 0 && alphabet.classes < symbols)
+	{
+		buffer = (symbol_t*)malloc(sample_buffer_size);
+		learned = (nfa_t*)malloc(sizeof(nfa_t));
+	}
+	if (buffer == NULL || learned == NULL)
+	{
+		free(buffer);
+		free(learned);
+		return oil_ex(sample_buffer, sample_buffer_size, sample_length, symbols,
+			pindices, ip_size, nindices, in_size, &compact, nfa);
+	}
+
+	alphabet_map(&alphabet, buffer, sample_buffer, sample_buffer_size);
+	bool complete = oil_ex(buffer, sample_buffer_size, sample_length, alphabet.classes,
+		pindices, ip_size, nindices, in_size, &compact, learned);
+	complete = alphabet_expand(&alphabet, nfa, learned) && complete;
+	nfa_set_symbol_major(nfa, config->symbol_major);
+	nfa_free(learned);
+	free(buffer);
+	free(learned);
+	return complete;
+}
+
+// Igual que oil() pero usando la configuracion suministrada
+bool oil_ex(const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const size_t sample_length,
+	const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	const oil_config_t* config,
+	nfa_t* nfa
+	)
+{
+	if (config->compact_alphabet)
+	{
+		return oil_ex_compact(sample_buffer, sample_buffer_size, sample_length, symbols,
+			pindices, ip_size, nindices, in_size, config, nfa);
+	}
+
+	// el estado crece con MAX_STATES y OIL_MAX_THREADS, no se reserva en la
+	// pila para no agotarla con BITSET_BITS grandes
+	oil_state_t* state = (oil_state_t*)malloc(sizeof(oil_state_t));
+	if (state == NULL)
+	{
+		nfa_init(nfa, symbols);
+		return false;
+	}
+	if (!oil_state_init(state, config, symbols, nfa))
+	{
+		free(state);
+		return false;
+	}
+
+	// indices de prefijos, si no hay memoria se simula cada muestra
+	if (config->use_trie)
+	{
+		oil_init_tries(state, sample_buffer, sample_length, pindices, ip_size, nindices, in_size);
+	}
+	OIL_METRIC_START(state->metrics, total_start);
+
+	uint32_t total_samples = 0;
+	for(uint16_t i=0; i<ip_size; i++)
+	{
+		total_samples += pindices[i].samples;
+	}
+	if(state->print_progress)
+	{
+		printf("%u total positive samples\n", total_samples);
+		printf("oil start. sample_length: %lu. ip_size: %lu, in_size: %lu, symbols: %u\n",
+			(unsigned long)sample_length, (unsigned long)ip_size, (unsigned long)in_size,
+			symbols);
+	}
+
+	oil_init_pending(state, pindices, ip_size, total_samples);
+
+	oil_init_reachability(state, sample_buffer, sample_length, nindices, in_size);
+
+	bool complete = true;
+	sample_iterator_t begin = sample_iterator_begin();
+	uint32_t begin_ordinal = 0;
+	oil_checkpoint_header_t checkpoint;
+	if (config->checkpoint_path != NULL)
+	{
+		oil_checkpoint_init(&checkpoint, config, sample_buffer, sample_length, symbols,
+			pindices, ip_size, nindices, in_size);
+	}
+
+	// si existe un checkpoint se continua desde la muestra que le sigue
+	FILE* in = config->checkpoint_path != NULL && config->resume ?
+		fopen(config->checkpoint_path, "rb") : NULL;
+	if (in != NULL)
+	{
+		bool resumed = oil_checkpoint_load(state, in, &checkpoint,
+			sample_buffer_size, sample_buffer, sample_length, &begin_ordinal);
+		fclose(in);
+		if (resumed)
+		{
+			uint32_t k;
+			for (k = 0; k < begin_ordinal; k++)
+			{
+				begin = sample_iterator_next(pindices, begin);
+			}
+			if (state->print_progress)
+			{
+				printf("oil resume: sample %u/%u [states: %u]\n",
+					begin_ordinal, total_samples, state->states);
+			}
+		}
+		else
+		{
+			if (state->print_progress)
+			{
+				printf("oil stop: %s is not a checkpoint of this run\n",
+					config->checkpoint_path);
+			}
+			nfa_free(nfa);
+			state->states = 0;
+			complete = false;
+		}
+	}
+
+	if (complete)
+	{
+		complete = oil_learn(state, config,
+			config->checkpoint_path != NULL ? &checkpoint : NULL,
+			sample_buffer, sample_buffer_size, sample_length,
+			pindices, ip_size, nindices, in_size,
+			begin, begin_ordinal, total_samples);
+	}
+
+	oil_state_free(state);
+
+	// la reduccion no cambia el lenguaje, la hipotesis sigue siendo
+	// consistente con todas las muestras
+	if (complete && config->reduce)
+	{
+		state->states = nfa_reduce(nfa);
+		assert(!nfa_accept_any_sample(nfa,
+			sample_buffer, sample_buffer_size, sample_length,
+			nindices, in_size,
+			sample_iterator_begin(), sample_iterator_end(in_size)));
+		assert(nfa_accept_all_samples(nfa,
+			sample_buffer, sample_buffer_size, sample_length,
+			pindices, ip_size,
+			sample_iterator_begin(), sample_iterator_end(ip_size)));
+	}
+	OIL_METRIC_ELAPSED(state->metrics, total_ns, total_start);
+	if (state->metrics != NULL && config->metrics_callback != NULL)
+	{
+		config->metrics_callback(state->metrics, config->metrics_user);
+	}
+	if (config->stats != NULL)
+	{
+		config->stats->merges_attempted = state->merge_attempts;
+		config->stats->merges_accepted = state->merge_counter;
+		config->stats->states = state->states;
+		config->stats->checkpoints = state->checkpoints;
+	}
+	free(state);
+	return complete;
+}
+
+// Retira transiciones de la hipotesis hasta que rechaza la muestra. Todo
+// camino de aceptacion usa exactamente una transicion en cada posicion, por
+// lo que basta retirar las de la posicion con menos transiciones en caminos
+// de aceptacion. El lenguaje solo se reduce. Retorna false si no hay memoria
+bool oil_cut_sample(nfa_t* nfa, const symbol_t* sample, const size_t length)
+{
+	bitset_t* f = (bitset_t*)malloc((length + 1) * sizeof(bitset_t));
+	bitset_t* b = (bitset_t*)malloc((length + 1) * sizeof(bitset_t));
+	if (f == NULL || b == NULL)
+	{
+		free(f);
+		free(b);
+		return false;
+	}
+
+	// estados alcanzados al leer los primeros k simbolos y estados desde los
+	// que el resto de la muestra lleva a un estado final
+	size_t k;
+	bitset_t tmp;
+	bitset_iterator_t j;
+	bitset_iterator_t i;
+	nfa_get_initials(nfa, &f[0]);
+	for (k = 0; k < length; k++)
+	{
+		nfa_step(nfa, &f[k], sample[k], &f[k + 1]);
+	}
+	nfa_get_finals(nfa, &b[length]);
+	for (k = length; k > 0; k--)
+	{
+		bitset_clear(&b[k - 1]);
+		for (j = bitset_first(&b[k]); !bitset_end(j); j = bitset_next(&b[k], j))
+		{
+			nfa_get_predecessors(nfa, bitset_element(j), sample[k - 1], &tmp);
+			bitset_union(&b[k - 1], &tmp);
+		}
+	}
+
+	size_t best = 0;
+	uint32_t best_edges = UINT32_MAX;
+	for (k = 0; k < length; k++)
+	{
+		uint32_t edges = 0;
+		for (j = bitset_first(&f[k]); !bitset_end(j); j = bitset_next(&f[k], j))
+		{
+			nfa_get_sucessors(nfa, bitset_element(j), sample[k], &tmp);
+			bitset_intersect(&tmp, &b[k + 1]);
+			for (i = bitset_first(&tmp); !bitset_end(i); i = bitset_next(&tmp, i))
+			{
+				edges++;
+			}
+		}
+		if (edges < best_edges)
+		{
+			best_edges = edges;
+			best = k;
+		}
+	}
+	for (j = bitset_first(&f[best]); !bitset_end(j); j = bitset_next(&f[best], j))
+	{
+		state_t p = bitset_element(j);
+		nfa_get_sucessors(nfa, p, sample[best], &tmp);
+		bitset_intersect(&tmp, &b[best + 1]);
+		for (i = bitset_first(&tmp); !bitset_end(i); i = bitset_next(&tmp, i))
+		{
+			nfa_remove_transition(nfa, p, bitset_element(i), sample[best]);
+		}
+	}
+	free(f);
+	free(b);
+	return true;
+}
+
+// Elimina los estados que quedaron inutiles despues de cortar transiciones,
+// los retira del vector de estados aleatorio y los marca sin usar
+void oil_release_useless_states(oil_state_t* state)
+{
+	nfa_trim(state->nfa);
+	bitset_t used;
+	nfa_used_states(state->nfa, &used);
+	state_t kept = 0;
+	state_t i;
+	for (i = 0; i < state->states; i++)
+	{
+		state_t q = state->pool[i];
+		if (bitset_contains(&used, q))
+		{
+			state->pool[kept++] = q;
+		}
+		else
+		{
+			bitset_add(&state->unused_states, q);
+		}
+	}
+	state->states = kept;
+	// la hipotesis cambio, los hilos la deben copiar de nuevo
+	state->nfa_version++;
+}
+
+// Aprendizaje incremental. Las muestras absorbidas se guardan en un solo
+// buffer, primero las positivas y luego las negativas, y se describen con
+// entradas consecutivas de a lo sumo UINT16_MAX muestras
+struct _oil_learner_t
+{
+	oil_state_t state;
+	oil_config_t config;
+	size_t sample_length;
+	symbol_t* samples;
+	uint32_t positives;
+	uint32_t negatives;
+	index_t pindices[MAX_INDICES];
+	index_t nindices[MAX_INDICES];
+	size_t ip_size;
+	size_t in_size;
+	// Ordinal de la proxima muestra positiva a procesar
+	uint32_t ordinal;
+};
+
+// Cantidad de muestras de un lote
+uint32_t oil_learner_count(const index_t* indices, const size_t i_size)
+{
+	uint32_t count = 0;
+	size_t k;
+	for (k = 0; k < i_size; k++)
+	{
+		count += indices[k].samples;
+	}
+	return count;
+}
+
+// Copia las muestras de un lote en dst. Retorna la posicion que sigue a la
+// ultima muestra copiada
+symbol_t* oil_learner_copy(symbol_t* dst, const symbol_t* sample_buffer,
+	const size_t sample_length, const index_t* indices, const size_t i_size)
+{
+	sample_iterator_t i;
+	for (i = sample_iterator_begin(); !sample_iterator_equals(i, sample_iterator_end(i_size));
+		i = sample_iterator_next(indices, i))
+	{
+		const index_t* desc = &indices[i.index];
+		memcpy(dst, sample_buffer + desc->begin + desc->stride * i.sample, sample_length);
+		dst += sample_length;
+	}
+	return dst;
+}
+
+// Describe count muestras consecutivas desde la posicion begin. Retorna la
+// cantidad de entradas
+size_t oil_learner_indices(index_t* indices, uint32_t begin, uint32_t count,
+	const size_t sample_length)
+{
+	size_t k = 0;
+	while (count > 0)
+	{
+		uint16_t samples = count < UINT16_MAX ? count : UINT16_MAX;
+		indices[k].begin = begin;
+		indices[k].samples = samples;
+		indices[k].stride = (uint8_t)sample_length;
+		begin += (uint32_t)samples * sample_length;
+		count -= samples;
+		k++;
+	}
+	return k;
+}
+
+// Crea un aprendiz incremental sobre nfa
+oil_learner_t* oil_learner_create(const oil_config_t* config,
+	const symbol_t symbols, const size_t sample_length, nfa_t* nfa)
+{
+	if (sample_length == 0 || sample_length > UINT8_MAX) return NULL;
+	oil_learner_t* learner = (oil_learner_t*)malloc(sizeof(oil_learner_t));
+	if (learner == NULL) return NULL;
+	learner->config = *config;
+	learner->config.checkpoint_path = NULL;
+	learner->config.resume = false;
+	learner->sample_length = sample_length;
+	learner->samples = NULL;
+	learner->positives = 0;
+	learner->negatives = 0;
+	learner->ip_size = 0;
+	learner->in_size = 0;
+	learner->ordinal = 0;
+	if (!oil_state_init(&learner->state, &learner->config, symbols, nfa))
+	{
+		free(learner);
+		return NULL;
+	}
+	return learner;
+}
+
+// Libera el aprendiz
+void oil_learner_free(oil_learner_t* learner)
+{
+	oil_state_free(&learner->state);
+	free(learner->samples);
+	free(learner);
+}
+
+// Comprueba que todas las muestras de un lote esten dentro del buffer
+bool oil_learner_fits(const size_t sample_buffer_size, const size_t sample_length,
+	const index_t* indices, const size_t i_size)
+{
+	size_t k;
+	for (k = 0; k < i_size; k++)
+	{
+		const index_t* desc = &indices[k];
+		if (desc->samples == 0) continue;
+		uint64_t last = (uint64_t)desc->begin + (uint64_t)desc->stride * (desc->samples - 1);
+		if (last + sample_length > sample_buffer_size) return false;
+	}
+	return true;
+}
+
+// Agrega un lote de muestras positivas y negativas
+bool oil_learner_update(oil_learner_t* learner,
+	const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size)
+{
+	oil_state_t* state = &learner->state;
+	const oil_config_t* config = &learner->config;
+	size_t length = learner->sample_length;
+	uint32_t old_negatives = learner->negatives;
+	uint64_t positives = (uint64_t)learner->positives + oil_learner_count(pindices, ip_size);
+	uint64_t negatives = (uint64_t)old_negatives + oil_learner_count(nindices, in_size);
+	uint64_t max_samples = (uint64_t)MAX_INDICES * UINT16_MAX;
+	if (positives > max_samples || negatives > max_samples ||
+		(positives + negatives) * length > UINT32_MAX ||
+		!oil_learner_fits(sample_buffer_size, length, pindices, ip_size) ||
+		!oil_learner_fits(sample_buffer_size, length, nindices, in_size))
+	{
+		return false;
+	}
+
+	// las positivas nuevas siguen a las anteriores para conservar sus
+	// ordinales, las negativas van al final
+	symbol_t* samples = (symbol_t*)malloc((positives + negatives) * length + 1);
+	if (samples == NULL) return false;
+	symbol_t* dst = samples;
+	if (learner->samples != NULL)
+	{
+		memcpy(dst, learner->samples, learner->positives * length);
+	}
+	dst = oil_learner_copy(dst + learner->positives * length,
+		sample_buffer, length, pindices, ip_size);
+	if (learner->samples != NULL)
+	{
+		memcpy(dst, learner->samples + learner->positives * length, old_negatives * length);
+	}
+	oil_learner_copy(dst + old_negatives * length, sample_buffer, length, nindices, in_size);
+	free(learner->samples);
+	learner->samples = samples;
+	learner->positives = (uint32_t)positives;
+	learner->negatives = (uint32_t)negatives;
+	learner->ip_size = oil_learner_indices(learner->pindices, 0, learner->positives, length);
+	learner->in_size = oil_learner_indices(learner->nindices,
+		(uint32_t)(positives * length), learner->negatives, length);
+	size_t samples_size = (positives + negatives) * length;
+
+	// las listas y tablas dependen de las muestras, se construyen de nuevo
+	oil_free_pending(state);
+	oil_free_reachability(state);
+	oil_free_tries(state);
+
+	// la hipotesis rechaza las negativas anteriores, si acepta alguna nueva
+	// se cortan transiciones hasta rechazarla. Las positivas que dejan de ser
+	// aceptadas se procesan de nuevo
+	bool repaired = false;
+	const symbol_t* negative = samples + (positives + old_negatives) * length;
+	const symbol_t* end = samples + samples_size;
+	for (; negative < end; negative += length)
+	{
+		if (!nfa_accept_sample(state->nfa, negative, length)) continue;
+		if (!oil_cut_sample(state->nfa, negative, length)) return false;
+		repaired = true;
+	}
+	if (repaired)
+	{
+		oil_release_useless_states(state);
+	}
+
+	if (config->use_trie)
+	{
+		oil_init_tries(state, samples, length,
+			learner->pindices, learner->ip_size, learner->nindices, learner->in_size);
+	}
+	oil_init_pending(state, learner->pindices, learner->ip_size, learner->positives);
+	oil_compact_pending(state, samples, length);
+	oil_init_reachability(state, samples, length, learner->nindices, learner->in_size);
+
+	// se continua desde la primera positiva rechazada
+	uint32_t k;
+	if (repaired)
+	{
+		for (k = 0; k < learner->ordinal; k++)
+		{
+			bool rejected = state->pending_offset != NULL ? state->rejected[k] :
+				!nfa_accept_sample(state->nfa, samples + (size_t)k * length, length);
+			if (rejected) break;
+		}
+		learner->ordinal = k;
+		if (state->print_progress)
+		{
+			printf("oil repair: sample %u/%u [states: %u]\n",
+				learner->ordinal, learner->positives, state->states);
+		}
+	}
+	sample_iterator_t begin = sample_iterator_begin();
+	for (k = 0; k < learner->ordinal; k++)
+	{
+		begin = sample_iterator_next(learner->pindices, begin);
+	}
+	bool complete = oil_learn(state, config, NULL,
+		samples, samples_size, length,
+		learner->pindices, learner->ip_size, learner->nindices, learner->in_size,
+		begin, learner->ordinal, learner->positives);
+	learner->ordinal = state->current_ordinal;
+
+	if (config->stats != NULL)
+	{
+		config->stats->merges_attempted = state->merge_attempts;
+		config->stats->merges_accepted = state->merge_counter;
+		config->stats->states = state->states;
+		config->stats->checkpoints = 0;
+	}
+	return complete;
+}
+
+// Ejecuciones de OIL con distinta semilla repartidas entre varios hilos
+typedef struct _oil_restart_task_t
+{
+	const symbol_t* sample_buffer;
+	size_t sample_buffer_size;
+	size_t sample_length;
+	symbol_t symbols;
+	const index_t* pindices;
+	size_t ip_size;
+	const index_t* nindices;
+	size_t in_size;
+	const oil_config_t* config;
+	int restarts;
+	bool cancel;
+
+	// Siguiente ejecucion, se reparte entre los hilos
+	int next;
+
+	// Menor cantidad de estados de una ejecucion completa
+	state_t bound;
+
+	// Por cada hilo: automata de la ejecucion en curso y mejor automata
+	// obtenido, con su ejecucion (-1 si ninguna termino) y estadisticas
+	nfa_t* nfa[OIL_MAX_THREADS];
+	nfa_t* best[OIL_MAX_THREADS];
+	int best_restart[OIL_MAX_THREADS];
+	oil_stats_t best_stats[OIL_MAX_THREADS];
+
+	// Contadores acumulados por cada hilo sobre todas sus ejecuciones
+	oil_metrics_t metrics[OIL_MAX_THREADS];
+} oil_restart_task_t;
+
+// Tarea de cada hilo: toma ejecuciones en orden ascendente hasta agotarlas
+// y conserva la mejor
+void oil_restart_worker(void* ctx, int worker)
+{
+	oil_restart_task_t* task = (oil_restart_task_t*)ctx;
+	for (;;)
+	{
+		int r = OIL_FETCH_ADD(&task->next, 1);
+		if (r >= task->restarts) break;
+
+		// libera las tablas de la ejecucion anterior
+		nfa_free(task->nfa[worker]);
+		oil_stats_t stats;
+		oil_config_t config = *task->config;
+		config.threads = 1;
+		config.seed = task->config->seed + r;
+		config.stats = &stats;
+		// la reduccion puede dejar menos estados de los que tenia la
+		// hipotesis al cancelar, en tal caso no se cancela
+		config.cancel_states = task->cancel && !config.reduce ? &task->bound : NULL;
+		config.metrics = task->config->metrics != NULL ? &task->metrics[worker] : NULL;
+		config.metrics_callback = NULL;
+		config.checkpoint_path = NULL;
+		config.resume = false;
+		bool complete = oil_ex(task->sample_buffer, task->sample_buffer_size,
+			task->sample_length, task->symbols,
+			task->pindices, task->ip_size, task->nindices, task->in_size,
+			&config, task->nfa[worker]);
+		if (!complete) continue;
+
+		// cada hilo toma las ejecuciones en orden, a igual cantidad de
+		// estados se conserva la primera
+		if (task->best_restart[worker] == -1 ||
+			stats.states < task->best_stats[worker].states)
+		{
+			nfa_t* tmp = task->best[worker];
+			task->best[worker] = task->nfa[worker];
+			task->nfa[worker] = tmp;
+			task->best_restart[worker] = r;
+			task->best_stats[worker] = stats;
+		}
+		state_t expected = OIL_LOAD(&task->bound);
+		while (stats.states < expected && !OIL_CAS(&task->bound, &expected, stats.states));
+	}
+}
+
+// Ejecuta OIL restarts veces con distinta semilla y conserva el automata
+// completo con menos estados
+bool oil_restarts(const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const size_t sample_length,
+	const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	const oil_config_t* config,
+	int restarts, bool cancel,
+	nfa_t* nfa
+	)
+{
+	int threads = 1;
+#ifdef OIL_THREADS
+	threads = config->threads;
+	if (threads > restarts) threads = restarts;
+	if (threads > OIL_MAX_THREADS) threads = OIL_MAX_THREADS;
+	if (threads > MAX_WORKERS) threads = MAX_WORKERS;
+	if (threads < 1) threads = 1;
+#endif
+
+	oil_restart_task_t task;
+	task.sample_buffer = sample_buffer;
+	task.sample_buffer_size = sample_buffer_size;
+	task.sample_length = sample_length;
+	task.symbols = symbols;
+	task.pindices = pindices;
+	task.ip_size = ip_size;
+	task.nindices = nindices;
+	task.in_size = in_size;
+	task.config = config;
+	task.restarts = restarts;
+	task.cancel = cancel;
+	task.next = 0;
+	task.bound = MAX_STATES;
+
+	// el hilo 0 usa nfa como automata de trabajo
+	bool ok = true;
+	int t;
+	for (t = 0; t < threads; t++)
+	{
+		task.nfa[t] = t == 0 ? nfa : (nfa_t*)malloc(sizeof(nfa_t));
+		task.best[t] = (nfa_t*)malloc(sizeof(nfa_t));
+		if (task.nfa[t] != NULL) nfa_init(task.nfa[t], symbols);
+		if (task.best[t] != NULL) nfa_init(task.best[t], symbols);
+		task.best_restart[t] = -1;
+		oil_metrics_init(&task.metrics[t]);
+		ok = ok && task.nfa[t] != NULL && task.best[t] != NULL;
+	}
+
+	// si no se pueden crear los hilos, el hilo 0 hace todas las ejecuciones
+	bool parallel = false;
+#ifdef OIL_THREADS
+	if (ok && threads > 1)
+	{
+		workers_t workers;
+		parallel = workers_init(&workers, threads);
+		if (parallel) workers_run(&workers, oil_restart_worker, &task);
+		workers_destroy(&workers);
+	}
+#endif
+	if (ok && !parallel)
+	{
+		oil_restart_worker(&task, 0);
+	}
+
+	// la mejor ejecucion de todos los hilos
+	int best = -1;
+	for (t = 0; t < threads && ok; t++)
+	{
+		if (task.best_restart[t] == -1) continue;
+		if (best == -1 ||
+			task.best_stats[t].states < task.best_stats[best].states ||
+			(task.best_stats[t].states == task.best_stats[best].states &&
+			task.best_restart[t] < task.best_restart[best]))
+		{
+			best = t;
+		}
+	}
+	if (best != -1 && task.best[best] != nfa && !nfa_clone(nfa, task.best[best]))
+	{
+		best = -1;
+	}
+	if (best != -1 && config->stats != NULL)
+	{
+		*config->stats = task.best_stats[best];
+	}
+
+	// los contadores suman todas las ejecuciones, el tiempo total de cada
+	// una se acumula aunque se ejecuten en paralelo
+	if (config->metrics != NULL)
+	{
+		for (t = 0; t < threads; t++)
+		{
+			oil_metrics_add(config->metrics, &task.metrics[t]);
+		}
+		if (config->metrics_callback != NULL)
+		{
+			config->metrics_callback(config->metrics, config->metrics_user);
+		}
+	}
+
+	for (t = 0; t < threads; t++)
+	{
+		if (task.nfa[t] != nfa && task.nfa[t] != NULL) nfa_free(task.nfa[t]);
+		if (task.best[t] != nfa && task.best[t] != NULL) nfa_free(task.best[t]);
+		if (task.nfa[t] != nfa) free(task.nfa[t]);
+		if (task.best[t] != nfa) free(task.best[t]);
+	}
+	return best != -1;
+}
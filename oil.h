@@ -13,14 +13,252 @@
 #pragma once
 #include "nfa.h"
 #include <stdlib.h>
+#include <stdio.h>
+
+// Cantidad maxima de hilos que puede usar OIL para evaluar mezclas
+#define OIL_MAX_THREADS 64
+
+// Memoria maxima para las tablas de alcanzabilidad de las muestras
+// negativas. Si se requiere mas, las muestras negativas se simulan completas
+#ifndef OIL_MAX_REACHABILITY_BYTES
+#define OIL_MAX_REACHABILITY_BYTES (64u * 1024u * 1024u)
+#endif
+
+// Estadisticas de una ejecucion de OIL
+typedef struct _oil_stats_t
+{
+	// Mezclas candidatas evaluadas
+	uint64_t merges_attempted;
+
+	// Mezclas realizadas
+	uint64_t merges_accepted;
+
+	// Estados en el automata al terminar
+	state_t states;
+
+	// Checkpoints escritos durante la ejecucion
+	uint32_t checkpoints;
+} oil_stats_t;
+
+// Contadores detallados de una ejecucion de OIL. Solo se recolectan si se
+// compila con OIL_METRICS, de lo contrario no tienen costo alguno. Las
+// simulaciones se cuentan en los caminos por defecto (listas y tablas de
+// alcanzabilidad), no al usar el indice de prefijos
+typedef struct _oil_metrics_t
+{
+	// Mezclas candidatas evaluadas
+	uint64_t candidates;
+
+	// Candidatos descartados porque no podian superar al mejor
+	uint64_t candidates_pruned;
+
+	// Candidatos rechazados por las tablas de alcanzabilidad, sin simular
+	uint64_t negative_rejections_table;
+
+	// Candidatos rechazados al simular muestras negativas
+	uint64_t negative_rejections;
+
+	// Muestras negativas y positivas simuladas al evaluar candidatos
+	uint64_t negative_simulations;
+	uint64_t positive_simulations;
+
+	// Pasos de simulacion (muestra, simbolo), incluye la actualizacion de
+	// las listas y tablas. Es una cota superior: la simulacion de un lote
+	// termina antes si todas sus muestras son rechazadas
+	uint64_t symbol_steps;
+
+	// Muestras positivas forzadas y mezclas realizadas
+	uint64_t samples_coerced;
+	uint64_t merges;
+
+	// Tiempo en nanosegundos de cada fase: forzar muestras, evaluar
+	// candidatos, aplicar mezclas (con la actualizacion de listas y tablas)
+	// y la ejecucion completa
+	uint64_t coerce_ns;
+	uint64_t evaluate_ns;
+	uint64_t commit_ns;
+	uint64_t total_ns;
+} oil_metrics_t;
+
+// Funcion que recibe los contadores despues de procesar cada muestra
+// positiva rechazada y al terminar la ejecucion
+typedef void (*oil_metrics_callback_t)(const oil_metrics_t* metrics, void* user);
+
+// Configuracion de una ejecucion de OIL
+typedef struct _oil_config_t
+{
+	// Ejecuta el algoritmo de manera que no utiliza orden aleatorio
+	bool no_random_sort;
+
+	// Si se habilita, OIL se conformara con la primera mezcla de estados
+	// que se considere valida
+	bool skip_search_best;
+
+	// Evalua todos los candidatos aunque no puedan superar al mejor
+	// encontrado. El resultado es el mismo, solo sirve para comprobar que
+	// descartarlos no cambia la mezcla elegida
+	bool no_prune;
+
+	// Revisa las muestras negativas en su orden original en lugar de revisar
+	// primero las que mas candidatos han descartado. El resultado es el
+	// mismo, solo sirve para comprobarlo
+	bool no_kill_order;
+
+	// Hilos usados para evaluar las mezclas candidatas. Solo tiene efecto
+	// si se compila con OIL_THREADS, de lo contrario se usa un solo hilo.
+	// El resultado no depende de la cantidad de hilos
+	int threads;
+
+	// Construye un indice de prefijos comunes (trie) de las muestras para
+	// simular una sola vez cada prefijo compartido al evaluar las mezclas.
+	// El resultado es el mismo, solo cambia el tiempo y la memoria usada
+	bool use_trie;
+
+	// Al terminar, reduce el NFA con nfa_reduce: elimina estados inutiles,
+	// mezcla estados bisimilares y renumera. El lenguaje no cambia y las
+	// estadisticas reportan los estados del NFA reducido
+	bool reduce;
+
+	// Aprende sobre un alfabeto compacto con solo los simbolos que aparecen
+	// en las muestras, numerados en orden creciente, y al terminar traduce
+	// el NFA al alfabeto original. El automata es el mismo, pero las
+	// mezclas, las copias de la hipotesis y las simulaciones recorren menos
+	// simbolos. Los checkpoints se refieren a las muestras traducidas
+	bool compact_alphabet;
+
+	// Usa la disposicion por simbolo en las tablas densas de la hipotesis y
+	// del NFA resultante (ver nfa_set_symbol_major), de manera que las
+	// simulaciones avanzan con el nucleo de nfa_step. El automata es el mismo
+	bool symbol_major;
+
+	// Informacion de depuracion que se imprime durante la ejecucion,
+	// desactivada por defecto. Imprimir las alternativas impide descartar
+	// candidatos con puntaje menor al de uno de indice mayor
+	bool print_merge_alternatives;
+	bool print_merges;
+	bool print_progress;
+
+	// Si no es NULL, recibe las estadisticas de la ejecucion
+	oil_stats_t* stats;
+
+	// Semilla del orden aleatorio. El resultado solo depende de la semilla,
+	// cada ejecucion tiene su propio generador
+	uint64_t seed;
+
+	// Si no es NULL, la ejecucion se cancela (y no se considera completa)
+	// cuando la hipotesis supera *cancel_states estados. El valor puede ser
+	// modificado por otro hilo durante la ejecucion
+	const state_t* cancel_states;
+
+	// Si no es NULL y se compila con OIL_METRICS, se acumulan en *metrics
+	// los contadores de la ejecucion (se deben inicializar con
+	// oil_metrics_init). metrics_callback, si no es NULL, se invoca con ellos
+	oil_metrics_t* metrics;
+	oil_metrics_callback_t metrics_callback;
+	void* metrics_user;
+
+	// Si checkpoint_path no es NULL, cada checkpoint_interval muestras
+	// positivas forzadas se guarda en ese archivo el estado completo del
+	// aprendizaje: la hipotesis, el vector de estados aleatorio, el
+	// generador pseudoaleatorio y las listas de muestras. El archivo se
+	// escribe aparte y luego se renombra, una interrupcion conserva el
+	// anterior. Si resume es true y el archivo existe, la ejecucion continua
+	// desde la muestra positiva siguiente a la guardada con el mismo
+	// resultado que una ejecucion sin interrupciones. Si el archivo no
+	// corresponde a las mismas muestras, simbolos, semilla, opciones y
+	// MAX_STATES, oil_ex retorna false sin aprender. Los contadores de
+	// metrics solo cubren la parte reanudada
+	const char* checkpoint_path;
+	uint32_t checkpoint_interval;
+	bool resume;
+} oil_config_t;
+
+// Inicializa los contadores en cero
+void oil_metrics_init(oil_metrics_t* metrics);
+
+// Escribe los contadores como un objeto JSON en una linea
+void oil_metrics_json(const oil_metrics_t* metrics, FILE* out);
+
+// Inicializa la configuracion con los valores por defecto
+void oil_config_init(oil_config_t* config);
 
 // Algoritmo que obtiene un automata NFA que puede reconocer un conjunto de
-// secuencias y rechazar otro.
-void oil(const symbol_t* sample_buffer,
+// secuencias y rechazar otro. Retorna false si el automata requiere mas de
+// MAX_STATES estados, en cuyo caso solo es consistente con las muestras
+// positivas procesadas hasta el momento. nfa se inicializa como con
+// nfa_init; con NFA_HEAP_DENSE, si ya contenia un automata se debe liberar
+// antes con nfa_free, y al terminar de usarlo tambien
+bool oil(const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const size_t sample_length,
+	const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	nfa_t* nfa
+	);
+
+// Igual que oil() pero usando la configuracion suministrada
+bool oil_ex(const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const size_t sample_length,
+	const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	const oil_config_t* config,
+	nfa_t* nfa
+	);
+
+// Aprendiz incremental: conserva el estado de OIL entre lotes de muestras
+// para absorber muestras nuevas sin procesar de nuevo las anteriores
+typedef struct _oil_learner_t oil_learner_t;
+
+// Crea un aprendiz incremental con una copia de la configuracion. nfa se
+// inicializa vacio, recibe la hipotesis despues de cada lote y debe existir
+// mientras se use el aprendiz. config->reduce, compact_alphabet,
+// checkpoint_path y resume no se usan. Retorna NULL si no hay memoria o
+// sample_length es 0 o mayor a 255
+oil_learner_t* oil_learner_create(const oil_config_t* config,
+	const symbol_t symbols, const size_t sample_length, nfa_t* nfa);
+
+// Agrega un lote de muestras positivas y negativas, descritas como en oil()
+// con el sample_length del aprendiz. Las muestras se copian. Solo se fuerzan
+// y mezclan las positivas nuevas que la hipotesis rechaza. Si la hipotesis
+// acepta alguna negativa nueva, se retiran transiciones hasta rechazarla y
+// se procesan de nuevo las positivas que dejan de ser aceptadas. Un unico
+// lote produce el mismo automata que oil_ex. Retorna false como oil_ex, si
+// las muestras no caben en MAX_INDICES entradas de UINT16_MAX muestras o si
+// alguna muestra se sale de sample_buffer_size; en estos dos casos el
+// aprendiz no cambia
+bool oil_learner_update(oil_learner_t* learner,
+	const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size);
+
+// Libera el aprendiz, el NFA conserva la ultima hipotesis
+void oil_learner_free(oil_learner_t* learner);
+
+// Ejecuta OIL restarts veces con las semillas config->seed,
+// config->seed + 1, ... y deja en nfa el automata completo con menos estados
+// (a igual cantidad, el de la primera semilla). Las ejecuciones se reparten
+// entre config->threads hilos y cada una usa un solo hilo. Si cancel es
+// true, se cancelan las ejecuciones que superan la cantidad de estados de la
+// mejor encontrada hasta el momento. Las mezclas solo retiran estados
+// agregados con la muestra actual, por lo que tras cada muestra la cantidad
+// de estados no disminuye y una ejecucion cancelada no podia ser elegida: el
+// resultado no depende de cancel ni de la cantidad de hilos. Con
+// config->reduce no se cancela. Las ejecuciones no guardan checkpoints.
+// config->stats recibe las estadisticas de la ejecucion elegida y
+// config->metrics la suma de todas las ejecuciones, metrics_callback se
+// invoca solo al terminar. nfa se inicializa como en oil(). Retorna false
+// si ninguna ejecucion termino
+bool oil_restarts(const symbol_t* sample_buffer,
 	const size_t sample_buffer_size,
 	const size_t sample_length,
 	const symbol_t symbols,
 	const index_t* pindices, const size_t ip_size,
 	const index_t* nindices, const size_t in_size,
+	const oil_config_t* config,
+	int restarts, bool cancel,
 	nfa_t* nfa
 	);
@@ -0,0 +1,96 @@
+// oil_auto.c
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene la seleccion de la anchura de bitset_t al ejecutar.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+#include "oil_auto.h"
+
+// Declara la instancia de OIL compilada con bits bits
+#define OIL_WIDTH_DECLARE(bits) \
+	bool oil_width_##bits(const symbol_t* sample_buffer, \
+		const size_t sample_buffer_size, const size_t sample_length, \
+		const symbol_t symbols, \
+		const index_t* pindices, const size_t ip_size, \
+		const index_t* nindices, const size_t in_size, \
+		const oil_config_t* config, \
+		void** model, size_t* model_size, uint32_t* states)
+
+OIL_WIDTH_DECLARE(64);
+OIL_WIDTH_DECLARE(128);
+OIL_WIDTH_DECLARE(256);
+OIL_WIDTH_DECLARE(512);
+OIL_WIDTH_DECLARE(4096);
+
+// MAX_STATES de cada instancia, ver nfa.h
+#define OIL_WIDTH_MAX_STATES(bits) ((bits) - 1u)
+
+// Instancia de OIL para una anchura
+typedef bool (*oil_width_learn_t)(const symbol_t* sample_buffer,
+	const size_t sample_buffer_size, const size_t sample_length,
+	const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	const oil_config_t* config,
+	void** model, size_t* model_size, uint32_t* states);
+
+typedef struct _oil_width_t
+{
+	uint32_t bits;
+	oil_width_learn_t learn;
+} oil_width_t;
+
+// Anchuras en orden creciente
+const oil_width_t oil_widths[OIL_AUTO_WIDTHS] =
+{
+	{ 64, oil_width_64 },
+	{ 128, oil_width_128 },
+	{ 256, oil_width_256 },
+	{ 512, oil_width_512 },
+	{ 4096, oil_width_4096 },
+};
+
+// Ejecuta OIL con la menor anchura en la que cabe el automata
+bool oil_auto(const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const size_t sample_length,
+	const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	const oil_config_t* config,
+	oil_auto_result_t* result
+	)
+{
+	result->model = NULL;
+	result->model_size = 0;
+	result->bits = 0;
+	result->states = 0;
+	int k;
+	for (k = 0; k < OIL_AUTO_WIDTHS; k++)
+	{
+		const oil_width_t* width = &oil_widths[k];
+		if (config->print_progress)
+		{
+			printf("oil auto: trying %u bits\n", width->bits);
+		}
+		if (width->learn(sample_buffer, sample_buffer_size, sample_length, symbols,
+			pindices, ip_size, nindices, in_size, config,
+			&result->model, &result->model_size, &result->states))
+		{
+			result->bits = width->bits;
+			return true;
+		}
+		// solo tiene sentido usar mas bits si se agotaron los estados; sin
+		// memoria una anchura mayor tambien fallaria
+		if (result->states < OIL_WIDTH_MAX_STATES(width->bits)) break;
+	}
+	result->states = 0;
+	return false;
+}
@@ -0,0 +1,59 @@
+// oil_auto.h
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene la seleccion de la anchura de bitset_t al ejecutar:
+// OIL se compila una vez por anchura y se usa la menor en la que cabe el
+// automata aprendido.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+//------------------------------------------------------------------------------
+#pragma once
+#include "oil.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Cantidad de anchuras de bitset_t con las que se compila OIL: 64, 128, 256,
+// 512 y 4096 bits. Cada una es un objeto oil_w<bits>.o que solo exporta
+// oil_width_<bits> (ver oil_width.c y OIL_WIDTHS en el Makefile)
+#define OIL_AUTO_WIDTHS 5
+
+// Resultado de oil_auto
+typedef struct _oil_auto_result_t
+{
+	// Automata aprendido en el formato de model.h, reservado con malloc. Se
+	// carga con model_map y se libera con free
+	void* model;
+	size_t model_size;
+
+	// BITSET_BITS de la instancia que aprendio el automata
+	uint32_t bits;
+
+	// Estados del automata aprendido
+	uint32_t states;
+} oil_auto_result_t;
+
+// Ejecuta OIL con la menor anchura de bitset_t y, si el automata requiere
+// mas de sus MAX_STATES estados, de nuevo con la anchura siguiente. Los
+// problemas pequenos se resuelven con la anchura de 64 bits, igual de rapido
+// que con oil_ex. config->stats, cancel_states, checkpoint_path y resume no
+// se usan; metrics acumula los contadores de todos los intentos. Retorna
+// false si el automata no cabe en la mayor anchura o si un intento falla por
+// otra causa, como falta de memoria, sin probar anchuras mayores. En tal
+// caso result->model es NULL
+bool oil_auto(const symbol_t* sample_buffer,
+	const size_t sample_buffer_size,
+	const size_t sample_length,
+	const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	const oil_config_t* config,
+	oil_auto_result_t* result
+	);
@@ -0,0 +1,62 @@
+// oil_width.c
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene la instancia de OIL para una anchura de bitset_t. Se
+// compila junto con el resto de OIL una vez por cada anchura, con
+// -DBITSET_BITS=<bits>, y el objeto resultante solo exporta
+// oil_width_<bits> (ver oil_auto.h).
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+#include "oil.h"
+#include "model.h"
+
+#define OIL_WIDTH_NAME_(bits) oil_width_##bits
+#define OIL_WIDTH_NAME(bits) OIL_WIDTH_NAME_(bits)
+
+// Ejecuta oil_ex con esta anchura y entrega el automata en el formato de
+// model.h. Retorna false si la ejecucion no termino o no hay memoria; si se
+// detuvo porque la siguiente muestra forzada no cabia en MAX_STATES, states
+// queda en MAX_STATES para que se intente con una anchura mayor
+bool OIL_WIDTH_NAME(BITSET_BITS)(const symbol_t* sample_buffer,
+	const size_t sample_buffer_size, const size_t sample_length,
+	const symbol_t symbols,
+	const index_t* pindices, const size_t ip_size,
+	const index_t* nindices, const size_t in_size,
+	const oil_config_t* config,
+	void** model, size_t* model_size, uint32_t* states)
+{
+	// las estadisticas y la cancelacion usan state_t, que depende de la
+	// anchura, y los checkpoints solo sirven para la misma MAX_STATES. Las
+	// estadisticas propias si se compilan con esta anchura
+	oil_stats_t stats;
+	stats.states = 0;
+	oil_config_t run = *config;
+	run.stats = &stats;
+	run.cancel_states = NULL;
+	run.checkpoint_path = NULL;
+	run.resume = false;
+
+	*model = NULL;
+	*model_size = 0;
+	*states = 0;
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	if (nfa == NULL) return false;
+	bool complete = oil_ex(sample_buffer, sample_buffer_size, sample_length, symbols,
+		pindices, ip_size, nindices, in_size, &run, nfa);
+	if (!complete && stats.states + sample_length + 1 > MAX_STATES)
+	{
+		*states = MAX_STATES;
+	}
+	complete = complete && model_save_buffer(model, model_size, nfa, NULL);
+	if (complete) *states = ((const model_header_t*)*model)->states;
+	nfa_free(nfa);
+	free(nfa);
+	return complete;
+}
@@ -0,0 +1,290 @@
+// reduce.c
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene la reduccion de los automatas aprendidos.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+#include "reduce.h"
+#include <string.h>
+
+// Posiciones de la tabla de dispersion de firmas, al menos el doble de
+// MAX_STATES y potencia de 2
+#define REDUCE_TABLE (2u * BITSET_BITS)
+
+// Obtiene los estados usados: iniciales, finales o con alguna transicion
+void nfa_used_states(const nfa_t* nfa, bitset_t* used)
+{
+	nfa_get_initials(nfa, used);
+	bitset_t tmp;
+	nfa_get_finals(nfa, &tmp);
+	bitset_union(used, &tmp);
+	symbol_t symbols = nfa_get_symbols(nfa);
+	state_t q;
+	for (q = 0; q < MAX_STATES; q++)
+	{
+		if (bitset_contains(used, q)) continue;
+		symbol_t a;
+		for (a = 0; a < symbols; a++)
+		{
+			nfa_get_sucessors(nfa, q, a, &tmp);
+			if (bitset_any(&tmp)) break;
+			nfa_get_predecessors(nfa, q, a, &tmp);
+			if (bitset_any(&tmp)) break;
+		}
+		if (a < symbols) bitset_add(used, q);
+	}
+}
+
+// Obtiene en reached los estados alcanzables desde from, siguiendo las
+// transiciones hacia adelante o, si backward es true, hacia atras
+void nfa_reach(const nfa_t* nfa, const bitset_t* from, bool backward, bitset_t* reached)
+{
+	symbol_t symbols = nfa_get_symbols(nfa);
+	bitset_t pending = *from;
+	*reached = *from;
+	while (bitset_any(&pending))
+	{
+		bitset_t next;
+		bitset_init(&next);
+		bitset_iterator_t j;
+		for (j = bitset_first(&pending); !bitset_end(j); j = bitset_next(&pending, j))
+		{
+			symbol_t a;
+			for (a = 0; a < symbols; a++)
+			{
+				bitset_t tmp;
+				if (backward) nfa_get_predecessors(nfa, bitset_element(j), a, &tmp);
+				else nfa_get_sucessors(nfa, bitset_element(j), a, &tmp);
+				bitset_union(&next, &tmp);
+			}
+		}
+		// solo se visitan los estados nuevos
+		bitset_init(&pending);
+		for (j = bitset_first(&next); !bitset_end(j); j = bitset_next(&next, j))
+		{
+			if (!bitset_contains(reached, bitset_element(j)))
+			{
+				bitset_add(&pending, bitset_element(j));
+				bitset_add(reached, bitset_element(j));
+			}
+		}
+	}
+}
+
+// Aisla el estado q eliminando sus transiciones y su caracter inicial y final
+void nfa_isolate_state(nfa_t* nfa, state_t q)
+{
+	nfa_remove_initial(nfa, q);
+	nfa_remove_final(nfa, q);
+	symbol_t symbols = nfa_get_symbols(nfa);
+	symbol_t a;
+	for (a = 0; a < symbols; a++)
+	{
+		bitset_t tmp;
+		bitset_iterator_t j;
+		nfa_get_sucessors(nfa, q, a, &tmp);
+		for (j = bitset_first(&tmp); !bitset_end(j); j = bitset_next(&tmp, j))
+		{
+			nfa_remove_transition(nfa, q, bitset_element(j), a);
+		}
+		nfa_get_predecessors(nfa, q, a, &tmp);
+		for (j = bitset_first(&tmp); !bitset_end(j); j = bitset_next(&tmp, j))
+		{
+			nfa_remove_transition(nfa, bitset_element(j), q, a);
+		}
+	}
+}
+
+// Elimina los estados inutiles
+state_t nfa_trim(nfa_t* nfa)
+{
+	bitset_t used;
+	bitset_t reachable;
+	bitset_t coreachable;
+	bitset_t tmp;
+	nfa_used_states(nfa, &used);
+	nfa_get_initials(nfa, &tmp);
+	nfa_reach(nfa, &tmp, false, &reachable);
+	nfa_get_finals(nfa, &tmp);
+	nfa_reach(nfa, &tmp, true, &coreachable);
+	bitset_intersect(&reachable, &coreachable);
+
+	state_t removed = 0;
+	bitset_iterator_t j;
+	for (j = bitset_first(&used); !bitset_end(j); j = bitset_next(&used, j))
+	{
+		if (bitset_contains(&reachable, bitset_element(j))) continue;
+		nfa_isolate_state(nfa, bitset_element(j));
+		removed++;
+	}
+	return removed;
+}
+
+// Obtiene en blocks los bloques de los sucesores (o predecesores) de q con
+// el simbolo a
+void nfa_signature(const nfa_t* nfa, const state_t* block, state_t q, symbol_t a,
+	bool backward, bitset_t* blocks)
+{
+	bitset_t tmp;
+	if (backward) nfa_get_predecessors(nfa, q, a, &tmp);
+	else nfa_get_sucessors(nfa, q, a, &tmp);
+	bitset_init(blocks);
+	bitset_iterator_t j;
+	for (j = bitset_first(&tmp); !bitset_end(j); j = bitset_next(&tmp, j))
+	{
+		bitset_add(blocks, block[bitset_element(j)]);
+	}
+}
+
+// Dispersion de la firma de q: su bloque y los bloques alcanzados con cada
+// simbolo
+uint32_t nfa_signature_hash(const nfa_t* nfa, const state_t* block, state_t q, bool backward)
+{
+	uint64_t h = (uint64_t)block[q] + 1;
+	symbol_t symbols = nfa_get_symbols(nfa);
+	symbol_t a;
+	for (a = 0; a < symbols; a++)
+	{
+		bitset_t blocks;
+		nfa_signature(nfa, block, q, a, backward, &blocks);
+		bucket_index_t i;
+		for (i = 0; i < MAX_BUCKETS; i++)
+		{
+			h = (h ^ blocks.buckets[i]) * 0x9E3779B97F4A7C15ull;
+		}
+	}
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+// Indica si p y q tienen la misma firma
+bool nfa_same_signature(const nfa_t* nfa, const state_t* block, state_t p, state_t q,
+	bool backward)
+{
+	if (block[p] != block[q]) return false;
+	symbol_t symbols = nfa_get_symbols(nfa);
+	symbol_t a;
+	for (a = 0; a < symbols; a++)
+	{
+		bitset_t x;
+		bitset_t y;
+		nfa_signature(nfa, block, p, a, backward, &x);
+		nfa_signature(nfa, block, q, a, backward, &y);
+		if (!bitset_equals(&x, &y)) return false;
+	}
+	return true;
+}
+
+// Mezcla los estados equivalentes por bisimulacion
+state_t nfa_merge_bisimilar(nfa_t* nfa, bool backward)
+{
+	bitset_t used;
+	nfa_used_states(nfa, &used);
+
+	// particion inicial segun el caracter final (inicial hacia atras); se
+	// refina hasta que los estados de cada bloque tienen la misma firma
+	state_t block[MAX_STATES];
+	state_t refined[MAX_STATES];
+	uint32_t table[REDUCE_TABLE];
+	state_t blocks = 0;
+	int32_t id[2] = { -1, -1 };
+	bitset_iterator_t j;
+	for (j = bitset_first(&used); !bitset_end(j); j = bitset_next(&used, j))
+	{
+		state_t q = bitset_element(j);
+		int flag = backward ? nfa_is_initial(nfa, q) : nfa_is_final(nfa, q);
+		if (id[flag] == -1) id[flag] = blocks++;
+		block[q] = (state_t)id[flag];
+	}
+	for (;;)
+	{
+		memset(table, 0, sizeof(table));
+		state_t refined_blocks = 0;
+		for (j = bitset_first(&used); !bitset_end(j); j = bitset_next(&used, j))
+		{
+			state_t q = bitset_element(j);
+			uint32_t h = nfa_signature_hash(nfa, block, q, backward) & (REDUCE_TABLE - 1);
+			while (table[h] != 0 &&
+				!nfa_same_signature(nfa, block, table[h] - 1, q, backward))
+			{
+				h = (h + 1) & (REDUCE_TABLE - 1);
+			}
+			if (table[h] == 0)
+			{
+				table[h] = q + 1;
+				refined[q] = refined_blocks++;
+			}
+			else
+			{
+				refined[q] = refined[table[h] - 1];
+			}
+		}
+		// cada ronda solo divide bloques, si no aumentan la particion es estable
+		if (refined_blocks == blocks) break;
+		memcpy(block, refined, sizeof(block));
+		blocks = refined_blocks;
+	}
+
+	// cada estado se mezcla en el primero de su bloque
+	state_t first[MAX_STATES];
+	state_t merged = 0;
+	state_t b;
+	for (b = 0; b < blocks; b++)
+	{
+		first[b] = MAX_STATES;
+	}
+	for (j = bitset_first(&used); !bitset_end(j); j = bitset_next(&used, j))
+	{
+		state_t q = bitset_element(j);
+		if (first[block[q]] == MAX_STATES)
+		{
+			first[block[q]] = q;
+		}
+		else
+		{
+			nfa_merge_states(nfa, first[block[q]], q);
+			merged++;
+		}
+	}
+	return merged;
+}
+
+// Renumera los estados usados en el rango 0..n-1
+state_t nfa_compact(nfa_t* nfa)
+{
+	bitset_t used;
+	nfa_used_states(nfa, &used);
+
+	// los estados conservan su orden, por lo que el destino de cada uno es
+	// un estado anterior ya liberado; mezclar con un estado aislado equivale
+	// a renombrar
+	state_t n = 0;
+	bitset_iterator_t j;
+	for (j = bitset_first(&used); !bitset_end(j); j = bitset_next(&used, j))
+	{
+		state_t q = bitset_element(j);
+		if (q != n) nfa_merge_states(nfa, n, q);
+		n++;
+	}
+	return n;
+}
+
+// Elimina estados inutiles, mezcla estados bisimilares y renumera
+state_t nfa_reduce(nfa_t* nfa)
+{
+	nfa_trim(nfa);
+	// una mezcla en un sentido puede habilitar otras en el otro
+	for (;;)
+	{
+		state_t merged = nfa_merge_bisimilar(nfa, false);
+		merged += nfa_merge_bisimilar(nfa, true);
+		if (merged == 0) break;
+	}
+	return nfa_compact(nfa);
+}
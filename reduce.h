@@ -0,0 +1,42 @@
+// reduce.h
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene la reduccion de los automatas aprendidos: elimina
+// los estados inutiles, mezcla los estados equivalentes por bisimulacion y
+// renumera los estados en un rango denso. El lenguaje no cambia.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M.
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+//------------------------------------------------------------------------------
+#pragma once
+#include "nfa.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Obtiene los estados usados: iniciales, finales o con alguna transicion
+void nfa_used_states(const nfa_t* nfa, bitset_t* used);
+
+// Elimina los estados inutiles: los que no se alcanzan desde un estado
+// inicial o desde los que no se alcanza un estado final. Retorna la
+// cantidad de estados eliminados
+state_t nfa_trim(nfa_t* nfa);
+
+// Mezcla los estados equivalentes por bisimulacion hacia adelante (con
+// igual caracter final y sucesores en los mismos bloques) o, si backward es
+// true, hacia atras (con igual caracter inicial y predecesores en los mismos
+// bloques). Retorna la cantidad de estados mezclados
+state_t nfa_merge_bisimilar(nfa_t* nfa, bool backward);
+
+// Renumera los estados usados en el rango 0..n-1 conservando su orden.
+// Retorna n
+state_t nfa_compact(nfa_t* nfa);
+
+// Aplica nfa_trim, mezcla estados bisimilares en ambos sentidos hasta que
+// no hay cambios y renumera con nfa_compact. Retorna la cantidad de estados
+state_t nfa_reduce(nfa_t* nfa);
@@ -14,28 +14,1349 @@
 // Pontificia Universidad Javeriana Cali
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "nfa.h"
 #include "oil.h"
+#include "dfa.h"
+#include "model.h"
+#include "oil_auto.h"
+#include "reduce.h"
+#include "alphabet.h"
+#ifdef OIL_THREADS
+#include "workers.h"
+#endif
 
 /////////////////////////////////////////////////////////////////////////////
 // TEST
 
-void test(void)
+int test(void)
 {
-	nfa_t nfa;
+	// con BITSET_BITS grandes los automatas no caben en la pila
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
 	symbol_t sample_buffer[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
 	size_t buffer_size = 12;
 	size_t sample_length = 3;
-	index_t pindices[] = { 3, 8 };
+	// cada muestra se describe con su inicio en el buffer
+	index_t pindices[] = { { 3, 1, 0 }, { 8, 1, 0 } };
 	size_t psize = 2;
-	index_t nindices[] = { 0, 1, 2, 4, 5, 6, 7, 9 };
+	index_t nindices[] = { { 0, 1, 0 }, { 1, 1, 0 }, { 2, 1, 0 }, { 4, 1, 0 },
+		{ 5, 1, 0 }, { 6, 1, 0 }, { 7, 1, 0 }, { 9, 1, 0 } };
 	size_t nsize = 8;
-	oil(sample_buffer, buffer_size, sample_length, 
+	bool complete = oil(sample_buffer, buffer_size, sample_length, 
 		13,
 		pindices, psize, 
 		nindices, nsize, 
-		&nfa);
-	nfa_print(&nfa);
+		nfa);
+	nfa_print(nfa);
+
+	int errors = 0;
+	if (!complete)
+	{
+		printf("test: oil did not complete\n");
+		errors++;
+	}
+	if (!nfa_accept_all_samples(nfa, sample_buffer, buffer_size, sample_length,
+		pindices, psize, sample_iterator_begin(), sample_iterator_end(psize)))
+	{
+		printf("test: positive sample rejected\n");
+		errors++;
+	}
+	if (nfa_accept_any_sample(nfa, sample_buffer, buffer_size, sample_length,
+		nindices, nsize, sample_iterator_begin(), sample_iterator_end(nsize)))
+	{
+		printf("test: negative sample accepted\n");
+		errors++;
+	}
+	nfa_free(nfa);
+	free(nfa);
+	return errors;
+}
+
+// Aprende con oil el automata de test(): 13 simbolos, muestras de 3
+// simbolos tomadas de 1..12
+bool test_example_nfa(nfa_t* nfa)
+{
+	symbol_t sample_buffer[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+	index_t pindices[] = { { 3, 1, 0 }, { 8, 1, 0 } };
+	index_t nindices[] = { { 0, 1, 0 }, { 1, 1, 0 }, { 2, 1, 0 }, { 4, 1, 0 },
+		{ 5, 1, 0 }, { 6, 1, 0 }, { 7, 1, 0 }, { 9, 1, 0 } };
+	return oil(sample_buffer, 12, 3, 13, pindices, 2, nindices, 8, nfa);
+}
+
+// Todas las palabras de hasta 4 simbolos sobre el alfabeto de test()
+typedef struct _test_words_t
+{
+	symbol_t* word;
+	const symbol_t** inputs;
+	uint16_t* lengths;
+	size_t count;
+} test_words_t;
+
+void test_words_init(test_words_t* words)
+{
+	words->count = 13 * 13 * 13 * 13 * 5;
+	words->word = (symbol_t*)malloc(words->count * 4);
+	words->inputs = (const symbol_t**)malloc(words->count * sizeof(symbol_t*));
+	words->lengths = (uint16_t*)malloc(words->count * sizeof(uint16_t));
+	size_t w;
+	for (w = 0; w < words->count; w++)
+	{
+		size_t v = w / 5;
+		uint16_t i;
+		for (i = 0; i < 4; i++)
+		{
+			words->word[w * 4 + i] = v % 13;
+			v /= 13;
+		}
+		words->inputs[w] = &words->word[w * 4];
+		words->lengths[w] = w % 5;
+	}
+}
+
+void test_words_free(test_words_t* words)
+{
+	free(words->word);
+	free(words->inputs);
+	free(words->lengths);
+}
+
+// Comprueba que el modelo guardado, con y sin DFA, reconoce el mismo
+// lenguaje que el NFA, tambien al reconstruir el NFA desde el archivo
+int test_model(void)
+{
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* loaded = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_init(loaded, 13);
+	bool complete = test_example_nfa(nfa);
+	dfa_t dfa;
+	complete = dfa_compile(&dfa, nfa, DFA_MAX_BYTES) && complete;
+	test_words_t words;
+	test_words_init(&words);
+
+	int errors = 0;
+	char path[] = "/tmp/oil_test_model_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1 || !complete)
+	{
+		printf("test: model fixture could not be created\n");
+		errors++;
+	}
+	else
+	{
+		close(fd);
+		int variant;
+		for (variant = 0; variant < 2; variant++)
+		{
+			model_t model;
+			if (!model_save(path, nfa, variant == 0 ? &dfa : NULL) ||
+				!model_open(&model, path))
+			{
+				printf("test: model could not be saved or opened\n");
+				errors++;
+				continue;
+			}
+			bool has_loaded = model_to_nfa(&model, loaded);
+			int differences = 0;
+			size_t w;
+			for (w = 0; w < words.count; w++)
+			{
+				bool expected = nfa_accept_sample(nfa, words.inputs[w], words.lengths[w]);
+				if (model_accept_sample(&model, words.inputs[w], words.lengths[w]) != expected ||
+					!has_loaded ||
+					nfa_accept_sample(loaded, words.inputs[w], words.lengths[w]) != expected)
+				{
+					differences++;
+				}
+			}
+			if (model.has_dfa != (variant == 0) || differences > 0)
+			{
+				printf("test: model classification differs on %d words\n", differences);
+				errors++;
+			}
+			nfa_free(loaded);
+			model_close(&model);
+		}
+		remove(path);
+	}
+	test_words_free(&words);
+	dfa_free(&dfa);
+	nfa_free(nfa);
+	free(nfa);
+	free(loaded);
+	return errors;
+}
+
+// Comprueba que el DFA compilado reconoce el mismo lenguaje que el NFA y
+// que sin espacio para compilarlo queda vacio
+int test_dfa(void)
+{
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	int errors = 0;
+	if (!test_example_nfa(nfa))
+	{
+		printf("test: oil did not complete\n");
+		errors++;
+	}
+	dfa_t dfa;
+	if (dfa_compile(&dfa, nfa, 1) || dfa.states != 0)
+	{
+		printf("test: dfa exceeded its size budget\n");
+		errors++;
+	}
+	dfa_free(&dfa);
+	if (!dfa_compile(&dfa, nfa, DFA_MAX_BYTES) || dfa_size(&dfa) > DFA_MAX_BYTES)
+	{
+		printf("test: dfa compilation failed\n");
+		errors++;
+	}
+	else
+	{
+		test_words_t words;
+		test_words_init(&words);
+		int differences = 0;
+		size_t w;
+		for (w = 0; w < words.count; w++)
+		{
+			if (dfa_accept_sample(&dfa, words.inputs[w], words.lengths[w]) !=
+				nfa_accept_sample(nfa, words.inputs[w], words.lengths[w]))
+			{
+				differences++;
+			}
+		}
+		if (differences > 0)
+		{
+			printf("test: dfa differs on %d words\n", differences);
+			errors++;
+		}
+		test_words_free(&words);
+	}
+	dfa_free(&dfa);
+	nfa_free(nfa);
+	free(nfa);
+	return errors;
+}
+
+// Comprueba que el clasificador, con DFA compilado o usando el NFA por
+// falta de espacio, reconoce el mismo lenguaje que el NFA, tambien al
+// clasificar por lotes
+int test_classify(void)
+{
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	int errors = 0;
+	if (!test_example_nfa(nfa))
+	{
+		printf("test: oil did not complete\n");
+		errors++;
+	}
+	dfa_classifier_t classifier;
+	dfa_classifier_t fallback;
+	if (!dfa_classifier_init(&classifier, nfa, DFA_MAX_BYTES))
+	{
+		printf("test: dfa compilation failed\n");
+		errors++;
+	}
+	if (dfa_classifier_init(&fallback, nfa, 1))
+	{
+		printf("test: dfa exceeded its size budget\n");
+		errors++;
+	}
+	test_words_t words;
+	test_words_init(&words);
+	uint64_t* results = (uint64_t*)malloc((words.count + 63) / 64 * sizeof(uint64_t));
+	uint64_t* fallback_results = (uint64_t*)malloc((words.count + 63) / 64 * sizeof(uint64_t));
+	// los mismos hilos clasifican ambos lotes
+	struct _workers_t* workers = NULL;
+#ifdef OIL_THREADS
+	workers_t pool;
+	if (workers_init(&pool, 3)) workers = &pool;
+	else workers_destroy(&pool);
+#endif
+	dfa_classify(&classifier, words.inputs, words.lengths, words.count, results, workers);
+	dfa_classify(&fallback, words.inputs, words.lengths, words.count, fallback_results, workers);
+#ifdef OIL_THREADS
+	if (workers != NULL) workers_destroy(workers);
+#endif
+	int differences = 0;
+	size_t w;
+	for (w = 0; w < words.count; w++)
+	{
+		const symbol_t* input = words.inputs[w];
+		uint16_t length = words.lengths[w];
+		bool expected = nfa_accept_sample(nfa, input, length);
+		if (dfa_classifier_accept(&classifier, input, length) != expected ||
+			dfa_classifier_accept(&fallback, input, length) != expected ||
+			(bool)(results[w / 64] >> (w % 64) & 1) != expected ||
+			(bool)(fallback_results[w / 64] >> (w % 64) & 1) != expected)
+		{
+			differences++;
+		}
+	}
+	if (differences > 0)
+	{
+		printf("test: classifier differs on %d words\n", differences);
+		errors++;
+	}
+	free(results);
+	free(fallback_results);
+	test_words_free(&words);
+	dfa_classifier_free(&classifier);
+	dfa_classifier_free(&fallback);
+	nfa_free(nfa);
+	free(nfa);
+	return errors;
+}
+
+// Comprueba la reduccion sobre un automata con dos estados finales
+// equivalentes y un estado inalcanzable
+int test_reduce(void)
+{
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* reduced = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_init(nfa, 2);
+	nfa_init(reduced, 2);
+	nfa_add_initial(nfa, 1);
+	nfa_add_transition(nfa, 1, 3, 0);
+	nfa_add_transition(nfa, 1, 5, 0);
+	nfa_add_transition(nfa, 3, 1, 1);
+	nfa_add_transition(nfa, 5, 1, 1);
+	nfa_add_final(nfa, 3);
+	nfa_add_final(nfa, 5);
+	nfa_add_transition(nfa, 6, 6, 0);
+	nfa_clone(reduced, nfa);
+
+	int errors = 0;
+	if (nfa_reduce(reduced) != 2)
+	{
+		printf("test: reduction did not leave 2 states\n");
+		errors++;
+	}
+	symbol_t word[6];
+	uint32_t w;
+	for (w = 0; w < 64; w++)
+	{
+		uint16_t length;
+		for (length = 0; length < 6; length++)
+		{
+			word[length] = (w >> length) & 1;
+		}
+		for (length = 0; length <= 6; length++)
+		{
+			if (nfa_accept_sample(nfa, word, length) != nfa_accept_sample(reduced, word, length))
+			{
+				printf("test: reduction changed the language\n");
+				errors++;
+			}
+		}
+	}
+	nfa_free(nfa);
+	nfa_free(reduced);
+	free(nfa);
+	free(reduced);
+	return errors;
+}
+
+// Muestras de prueba: las 64 palabras binarias de longitud 6, positivas si
+// la cantidad de unos es multiplo de 3
+typedef struct _test_samples_t
+{
+	symbol_t buffer[64 * 6];
+	index_t pindices[64];
+	index_t nindices[64];
+	size_t psize;
+	size_t nsize;
+} test_samples_t;
+
+// Escribe las muestras con los simbolos zero y one. Si skip es true se
+// omiten las palabras multiplo de 3, para que queden muestras sin ver
+void test_samples_init(test_samples_t* samples, symbol_t zero, symbol_t one, bool skip)
+{
+	samples->psize = 0;
+	samples->nsize = 0;
+	uint32_t w;
+	for (w = 0; w < 64; w++)
+	{
+		int ones = 0;
+		int k;
+		for (k = 0; k < 6; k++)
+		{
+			samples->buffer[w * 6 + k] = (w >> k) & 1 ? one : zero;
+			ones += (w >> k) & 1;
+		}
+		index_t desc = { w * 6, 1, 0 };
+		if (skip && w % 3 == 0) continue;
+		if (ones % 3 == 0) samples->pindices[samples->psize++] = desc;
+		else samples->nindices[samples->nsize++] = desc;
+	}
+}
+
+// Ejecuta oil_ex sobre las muestras con un alfabeto de symbols simbolos
+bool test_oil(const test_samples_t* samples, symbol_t symbols,
+	const oil_config_t* config, nfa_t* nfa)
+{
+	return oil_ex(samples->buffer, sizeof(samples->buffer), 6, symbols,
+		samples->pindices, samples->psize, samples->nindices, samples->nsize, config, nfa);
+}
+
+// Indica si el NFA acepta todas las muestras positivas y rechaza todas las
+// negativas
+bool test_consistent(const test_samples_t* samples, const nfa_t* nfa)
+{
+	return nfa_accept_all_samples(nfa, samples->buffer, sizeof(samples->buffer), 6,
+			samples->pindices, samples->psize,
+			sample_iterator_begin(), sample_iterator_end(samples->psize)) &&
+		!nfa_accept_any_sample(nfa, samples->buffer, sizeof(samples->buffer), 6,
+			samples->nindices, samples->nsize,
+			sample_iterator_begin(), sample_iterator_end(samples->nsize));
+}
+
+// Indica si dos NFA tienen los mismos estados iniciales, finales y
+// transiciones en ambos sentidos
+bool test_same_nfa(const nfa_t* a, const nfa_t* b)
+{
+	bool same = nfa_get_symbols(a) == nfa_get_symbols(b);
+	state_t q;
+	for (q = 0; same && q < MAX_STATES; q++)
+	{
+		same = nfa_is_initial(a, q) == nfa_is_initial(b, q) &&
+			nfa_is_final(a, q) == nfa_is_final(b, q);
+		symbol_t c;
+		for (c = 0; c < nfa_get_symbols(a); c++)
+		{
+			bitset_t x;
+			bitset_t y;
+			nfa_get_sucessors(a, q, c, &x);
+			nfa_get_sucessors(b, q, c, &y);
+			same = same && bitset_equals(&x, &y);
+			nfa_get_predecessors(a, q, c, &x);
+			nfa_get_predecessors(b, q, c, &y);
+			same = same && bitset_equals(&x, &y);
+		}
+	}
+	return same;
+}
+
+// Comprueba que la cache de pasos no cambia el resultado, tampoco al
+// reutilizarla ni al modificar el automata entre simulaciones: una mezcla,
+// su reversion, una transicion nueva y un estado final menos
+int test_cache(void)
+{
+	test_samples_t* samples = (test_samples_t*)malloc(sizeof(test_samples_t));
+	test_samples_init(samples, 0, 1, false);
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_cache_t* cache = (nfa_cache_t*)malloc(sizeof(nfa_cache_t));
+	nfa_merge_log_t* log = (nfa_merge_log_t*)malloc(sizeof(nfa_merge_log_t));
+	nfa_cache_init(cache);
+	nfa_merge_log_init(log, 2);
+	oil_config_t config;
+	oil_config_init(&config);
+	bool complete = test_oil(samples, 2, &config, nfa);
+
+	// dos estados usados, el primero es final
+	bitset_t used;
+	nfa_used_states(nfa, &used);
+	bitset_iterator_t j = bitset_first(&used);
+	state_t q1 = bitset_element(j);
+	state_t q2 = bitset_element(bitset_next(&used, j));
+	nfa_add_final(nfa, q1);
+
+	int errors = 0;
+	int pass;
+	for (pass = 0; pass < 6; pass++)
+	{
+		if (pass == 2) nfa_merge_states_logged(nfa, q1, q2, log);
+		if (pass == 3) nfa_merge_rollback(nfa, log);
+		if (pass == 4) nfa_add_transition(nfa, q2, q1, 1);
+		if (pass == 5) nfa_remove_final(nfa, q1);
+		int differences = 0;
+		uint32_t w;
+		for (w = 0; w < 64; w++)
+		{
+			uint16_t length;
+			for (length = 0; length <= 6; length++)
+			{
+				const symbol_t* word = &samples->buffer[w * 6];
+				if (nfa_accept_sample_cached(nfa, cache, word, length) !=
+					nfa_accept_sample(nfa, word, length))
+				{
+					differences++;
+				}
+			}
+		}
+		if (!complete || differences > 0)
+		{
+			printf("test: cached simulation differs on %d words (pass %d)\n",
+				differences, pass);
+			errors++;
+		}
+	}
+	if (cache->hits == 0)
+	{
+		printf("test: cache was never hit\n");
+		errors++;
+	}
+	free(samples);
+	free(cache);
+	nfa_merge_log_free(log);
+	free(log);
+	nfa_free(nfa);
+	free(nfa);
+	return errors;
+}
+
+// Comprueba que sin orden aleatorio el vector de estados se conserva al
+// retirar los estados mezclados y el automata es consistente
+int test_no_random_sort(void)
+{
+	test_samples_t* samples = (test_samples_t*)malloc(sizeof(test_samples_t));
+	test_samples_init(samples, 0, 1, false);
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	oil_config_t config;
+	oil_config_init(&config);
+	oil_stats_t stats;
+	config.no_random_sort = true;
+	config.stats = &stats;
+	bool complete = test_oil(samples, 2, &config, nfa);
+
+	// cada estado del vector aparece una sola vez, asi que la cantidad de
+	// estados coincide con la de estados usados en el automata
+	bitset_t used;
+	nfa_used_states(nfa, &used);
+	state_t count = 0;
+	bitset_iterator_t j;
+	for (j = bitset_first(&used); !bitset_end(j); j = bitset_next(&used, j))
+	{
+		count++;
+	}
+	int errors = 0;
+	if (!complete || !test_consistent(samples, nfa) || count != stats.states)
+	{
+		printf("test: run without random order is not consistent\n");
+		errors++;
+	}
+	free(samples);
+	nfa_free(nfa);
+	free(nfa);
+	return errors;
+}
+
+// Comprueba que aprender con reduce deja un automata consistente con las
+// muestras y sin mas estados que sin reducir. Sin las palabras multiplo de 3
+// la primera semilla lleva a un automata grande
+int test_oil_reduce(void)
+{
+	test_samples_t* samples = (test_samples_t*)malloc(sizeof(test_samples_t));
+	test_samples_init(samples, 0, 1, true);
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* reduced = (nfa_t*)malloc(sizeof(nfa_t));
+	oil_stats_t stats;
+	oil_stats_t reduced_stats;
+	oil_config_t config;
+	oil_config_init(&config);
+	config.stats = &stats;
+	bool complete = test_oil(samples, 2, &config, nfa);
+	config.stats = &reduced_stats;
+	config.reduce = true;
+	complete = test_oil(samples, 2, &config, reduced) && complete;
+	int errors = 0;
+	if (!complete || !test_consistent(samples, reduced) ||
+		reduced_stats.states > stats.states)
+	{
+		printf("test: reduced run is not consistent or has more states\n");
+		errors++;
+	}
+	free(samples);
+	nfa_free(nfa);
+	nfa_free(reduced);
+	free(nfa);
+	free(reduced);
+	return errors;
+}
+
+// Comprueba que evaluar las mezclas con varios hilos produce el mismo
+// automata que con uno solo, con y sin skip_search_best, y que descartar los
+// candidatos que no pueden superar al mejor no cambia las mezclas elegidas
+int test_threads(void)
+{
+	test_samples_t* samples = (test_samples_t*)malloc(sizeof(test_samples_t));
+	test_samples_init(samples, 0, 1, false);
+	nfa_t* serial = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* threaded = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* unpruned = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_init(serial, 2);
+	nfa_init(threaded, 2);
+	nfa_init(unpruned, 2);
+	oil_config_t config;
+	oil_config_init(&config);
+	int errors = 0;
+	int skip;
+	for (skip = 0; skip < 2; skip++)
+	{
+		config.skip_search_best = skip != 0;
+		config.threads = 1;
+		config.no_prune = true;
+		nfa_free(unpruned);
+		bool complete = test_oil(samples, 2, &config, unpruned);
+		config.no_prune = false;
+		nfa_free(serial);
+		complete = test_oil(samples, 2, &config, serial) && complete;
+		config.threads = 4;
+		nfa_free(threaded);
+		complete = test_oil(samples, 2, &config, threaded) && complete;
+		if (!complete || !test_same_nfa(serial, threaded))
+		{
+			printf("test: %d threads differ from one (skip_search_best: %d)\n",
+				config.threads, skip);
+			errors++;
+		}
+		if (!complete || !test_same_nfa(serial, unpruned))
+		{
+			printf("test: pruned search differs from a full one (skip_search_best: %d)\n",
+				skip);
+			errors++;
+		}
+	}
+	free(samples);
+	nfa_free(serial);
+	nfa_free(threaded);
+	nfa_free(unpruned);
+	free(serial);
+	free(threaded);
+	free(unpruned);
+	return errors;
+}
+
+// Comprueba que oil_restarts elige el mismo automata con uno y con varios
+// hilos, cancelando o no las ejecuciones que superan a la mejor, y que este
+// no tiene mas estados que la ejecucion de la primera semilla. Sin las
+// palabras multiplo de 3 las semillas 5, 6 y 7 llevan a automatas de
+// distinto tamano
+int test_restarts(void)
+{
+	test_samples_t* samples = (test_samples_t*)malloc(sizeof(test_samples_t));
+	test_samples_init(samples, 0, 1, true);
+	nfa_t* expected = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_init(expected, 2);
+	nfa_init(nfa, 2);
+	oil_stats_t single;
+	oil_stats_t expected_stats;
+	oil_stats_t stats;
+	oil_config_t config;
+	oil_config_init(&config);
+	config.seed = 5;
+	config.stats = &single;
+	bool complete = test_oil(samples, 2, &config, nfa);
+	config.stats = &expected_stats;
+	complete = oil_restarts(samples->buffer, sizeof(samples->buffer), 6, 2,
+		samples->pindices, samples->psize, samples->nindices, samples->nsize,
+		&config, 3, false, expected) && complete;
+	int errors = 0;
+	if (!complete || !test_consistent(samples, expected) ||
+		expected_stats.states > single.states)
+	{
+		printf("test: restarts did not keep the smallest consistent automaton\n");
+		errors++;
+	}
+	config.stats = &stats;
+	int threads;
+	for (threads = 1; threads <= 3; threads += 2)
+	{
+		int cancel;
+		for (cancel = 0; cancel < 2; cancel++)
+		{
+			config.threads = threads;
+			nfa_free(nfa);
+			bool same = oil_restarts(samples->buffer, sizeof(samples->buffer), 6, 2,
+				samples->pindices, samples->psize, samples->nindices, samples->nsize,
+				&config, 3, cancel != 0, nfa) &&
+				stats.states == expected_stats.states && test_same_nfa(nfa, expected);
+			if (!same)
+			{
+				printf("test: restarts differ with %d threads (cancel: %d)\n",
+					threads, cancel);
+				errors++;
+			}
+		}
+	}
+	free(samples);
+	nfa_free(expected);
+	nfa_free(nfa);
+	free(expected);
+	free(nfa);
+	return errors;
+}
+
+#ifdef OIL_METRICS
+// Cuenta las invocaciones de metrics_callback
+void test_metrics_callback(const oil_metrics_t* metrics, void* user)
+{
+	(void)metrics;
+	(*(int*)user)++;
+}
+
+// Comprueba que los contadores coinciden con las estadisticas, que
+// metrics_callback se invoca tras cada muestra forzada y al terminar, y que
+// se pueden escribir como JSON
+int test_metrics(void)
+{
+	test_samples_t* samples = (test_samples_t*)malloc(sizeof(test_samples_t));
+	test_samples_init(samples, 0, 1, false);
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	oil_metrics_t metrics;
+	oil_metrics_init(&metrics);
+	oil_stats_t stats;
+	int calls = 0;
+	oil_config_t config;
+	oil_config_init(&config);
+	config.stats = &stats;
+	config.metrics = &metrics;
+	config.metrics_callback = test_metrics_callback;
+	config.metrics_user = &calls;
+	bool complete = test_oil(samples, 2, &config, nfa);
+	int errors = 0;
+	if (!complete || metrics.merges != stats.merges_accepted ||
+		metrics.candidates != stats.merges_attempted ||
+		metrics.candidates < metrics.candidates_pruned ||
+		metrics.samples_coerced == 0 || metrics.total_ns == 0 ||
+		calls != (int)metrics.samples_coerced + 1)
+	{
+		printf("test: metrics do not match the run statistics\n");
+		errors++;
+	}
+
+	char json[1024];
+	FILE* out = tmpfile();
+	size_t length = 0;
+	if (out != NULL)
+	{
+		oil_metrics_json(&metrics, out);
+		rewind(out);
+		length = fread(json, 1, sizeof(json) - 1, out);
+		fclose(out);
+	}
+	json[length] = 0;
+	if (length == 0 || json[0] != '{' || strstr(json, "\"candidates\":") == NULL)
+	{
+		printf("test: metrics were not written as JSON\n");
+		errors++;
+	}
+	free(samples);
+	nfa_free(nfa);
+	free(nfa);
+	return errors;
+}
+#endif
+
+// Comprueba que simular las muestras con el indice de prefijos produce el
+// mismo automata que simularlas una a una, con uno y con varios hilos
+int test_trie(void)
+{
+	test_samples_t* samples = (test_samples_t*)malloc(sizeof(test_samples_t));
+	test_samples_init(samples, 0, 1, false);
+	nfa_t* expected = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_init(expected, 2);
+	nfa_init(nfa, 2);
+	oil_config_t config;
+	oil_config_init(&config);
+	int errors = 0;
+	int threads;
+	for (threads = 1; threads <= 4; threads += 3)
+	{
+		config.threads = threads;
+		config.use_trie = false;
+		nfa_free(expected);
+		bool complete = test_oil(samples, 2, &config, expected);
+		config.use_trie = true;
+		nfa_free(nfa);
+		complete = test_oil(samples, 2, &config, nfa) && complete;
+		if (!complete || !test_same_nfa(nfa, expected))
+		{
+			printf("test: prefix index changed the automaton with %d threads\n", threads);
+			errors++;
+		}
+	}
+	free(samples);
+	nfa_free(expected);
+	nfa_free(nfa);
+	free(expected);
+	free(nfa);
+	return errors;
+}
+
+// Comprueba que revisar primero las muestras negativas que mas candidatos
+// descartan no cambia el automata. Las 4096 palabras binarias de 12
+// simbolos, positivas si el numero que forman (primero el bit menos
+// significativo) es multiplo de 7, dejan miles de negativas que descartan
+// candidatos
+int test_kill_order(void)
+{
+	symbol_t* buffer = (symbol_t*)malloc(4096 * 12);
+	index_t* pindices = (index_t*)malloc(4096 * sizeof(index_t));
+	index_t* nindices = (index_t*)malloc(4096 * sizeof(index_t));
+	size_t psize = 0;
+	size_t nsize = 0;
+	uint32_t w;
+	for (w = 0; w < 4096; w++)
+	{
+		int k;
+		for (k = 0; k < 12; k++)
+		{
+			buffer[w * 12 + k] = (w >> k) & 1;
+		}
+		index_t desc = { w * 12, 1, 0 };
+		if (w % 7 == 0) pindices[psize++] = desc;
+		else nindices[nsize++] = desc;
+	}
+
+	nfa_t* ordered = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* unordered = (nfa_t*)malloc(sizeof(nfa_t));
+	oil_config_t config;
+	oil_config_init(&config);
+	bool complete = oil_ex(buffer, 4096 * 12, 12, 2, pindices, psize, nindices, nsize,
+		&config, ordered);
+	config.no_kill_order = true;
+	complete = oil_ex(buffer, 4096 * 12, 12, 2, pindices, psize, nindices, nsize,
+		&config, unordered) && complete;
+	int errors = 0;
+	if (!complete || !test_same_nfa(ordered, unordered))
+	{
+		printf("test: negative order changed the automaton\n");
+		errors++;
+	}
+	free(buffer);
+	free(pindices);
+	free(nindices);
+	nfa_free(ordered);
+	nfa_free(unordered);
+	free(ordered);
+	free(unordered);
+	return errors;
+}
+
+// Comprueba que una ejecucion reanudada desde un checkpoint termina con el
+// mismo automata que una sin interrupciones
+int test_checkpoint(void)
+{
+	test_samples_t* samples = (test_samples_t*)malloc(sizeof(test_samples_t));
+	test_samples_init(samples, 0, 1, true);
+
+	const char* path = "oil_test.checkpoint";
+	nfa_t* expected = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* resumed = (nfa_t*)malloc(sizeof(nfa_t));
+	oil_stats_t expected_stats;
+	oil_stats_t stats;
+	oil_config_t config;
+	oil_config_init(&config);
+	config.stats = &expected_stats;
+	bool complete = test_oil(samples, 2, &config, expected);
+
+	// el ultimo checkpoint queda antes de la ultima muestra forzada, salvo
+	// que la cantidad de muestras forzadas sea multiplo del intervalo
+	remove(path);
+	config.stats = &stats;
+	config.checkpoint_path = path;
+	config.checkpoint_interval = 2;
+	complete = test_oil(samples, 2, &config, resumed) && complete;
+	int errors = 0;
+	if (stats.checkpoints == 0)
+	{
+		printf("test: no checkpoint was written\n");
+		errors++;
+	}
+	config.resume = true;
+	nfa_free(resumed);
+	complete = test_oil(samples, 2, &config, resumed) && complete;
+	bool same = complete && stats.states == expected_stats.states &&
+		stats.merges_attempted == expected_stats.merges_attempted &&
+		stats.merges_accepted == expected_stats.merges_accepted &&
+		test_same_nfa(resumed, expected);
+	if (!same)
+	{
+		printf("test: resumed run differs from an uninterrupted one\n");
+		errors++;
+	}
+
+	// un checkpoint de otra semilla no se reanuda
+	config.seed++;
+	nfa_free(resumed);
+	if (test_oil(samples, 2, &config, resumed))
+	{
+		printf("test: checkpoint of another run was resumed\n");
+		errors++;
+	}
+	remove(path);
+	free(samples);
+	nfa_free(expected);
+	nfa_free(resumed);
+	free(expected);
+	free(resumed);
+	return errors;
+}
+
+// Comprueba que el aprendiz incremental termina con una hipotesis
+// consistente con todas las muestras cuando estas llegan en dos lotes, y que
+// un unico lote produce el mismo automata que oil_ex
+int test_learner(void)
+{
+	test_samples_t* samples = (test_samples_t*)malloc(sizeof(test_samples_t));
+	test_samples_init(samples, 0, 1, false);
+	const symbol_t* buffer = samples->buffer;
+	size_t buffer_size = sizeof(samples->buffer);
+	const index_t* pindices = samples->pindices;
+	const index_t* nindices = samples->nindices;
+	size_t psize = samples->psize;
+	size_t nsize = samples->nsize;
+
+	nfa_t* expected = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	oil_config_t config;
+	oil_config_init(&config);
+	int errors = 0;
+
+	// un unico lote
+	bool complete = test_oil(samples, 2, &config, expected);
+	oil_learner_t* learner = oil_learner_create(&config, 2, 6, nfa);
+	complete = learner != NULL && complete &&
+		oil_learner_update(learner, buffer, buffer_size, pindices, psize, nindices, nsize);
+	if (learner != NULL) oil_learner_free(learner);
+	if (!complete || !test_same_nfa(nfa, expected))
+	{
+		printf("test: single batch differs from oil_ex\n");
+		errors++;
+	}
+
+	// dos lotes, el primero con pocas negativas para forzar reparaciones
+	nfa_free(nfa);
+	learner = oil_learner_create(&config, 2, 6, nfa);
+	complete = learner != NULL &&
+		oil_learner_update(learner, buffer, buffer_size,
+			pindices, psize / 2, nindices, 4) &&
+		oil_learner_update(learner, buffer, buffer_size,
+			pindices + psize / 2, psize - psize / 2, nindices + 4, nsize - 4);
+	// un lote que se sale del buffer se rechaza sin cambiar el aprendiz
+	index_t outside = { (uint32_t)buffer_size - 5, 1, 6 };
+	if (learner != NULL &&
+		oil_learner_update(learner, buffer, buffer_size, &outside, 1, nindices, 0))
+	{
+		printf("test: learner accepted a sample outside the buffer\n");
+		errors++;
+	}
+	if (learner != NULL) oil_learner_free(learner);
+	if (!complete)
+	{
+		printf("test: incremental learner did not complete\n");
+		errors++;
+	}
+	if (!test_consistent(samples, nfa))
+	{
+		printf("test: incremental learner is not consistent with the samples\n");
+		errors++;
+	}
+	free(samples);
+	nfa_free(expected);
+	nfa_free(nfa);
+	free(expected);
+	free(nfa);
+	return errors;
+}
+
+// Comprueba que aprender sobre el alfabeto compacto produce el mismo
+// automata que sobre el original. Las muestras se escriben con los simbolos
+// 17 y 200 de un alfabeto de 250
+int test_alphabet(void)
+{
+	test_samples_t* samples = (test_samples_t*)malloc(sizeof(test_samples_t));
+	test_samples_init(samples, 17, 200, true);
+	nfa_t* expected = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	oil_config_t config;
+	oil_config_init(&config);
+	bool complete = test_oil(samples, 250, &config, expected);
+	config.compact_alphabet = true;
+	complete = test_oil(samples, 250, &config, nfa) && complete;
+
+	int errors = 0;
+	if (!complete || !test_same_nfa(nfa, expected))
+	{
+		printf("test: compact alphabet changed the learned NFA\n");
+		errors++;
+	}
+
+	// los simbolos sin transiciones forman una sola clase
+	alphabet_t alphabet;
+	alphabet_from_nfa(&alphabet, nfa);
+	if (alphabet.classes != 3 || alphabet.class_of[17] == alphabet.class_of[200] ||
+		alphabet.class_of[0] != alphabet.class_of[249])
+	{
+		printf("test: wrong symbol classes\n");
+		errors++;
+	}
+	free(samples);
+	nfa_free(expected);
+	nfa_free(nfa);
+	free(expected);
+	free(nfa);
+	return errors;
+}
+
+// Comprueba que la mezcla por palabras de las tablas densas da el mismo
+// automata que la de la representacion dispersa, con lazos y transiciones
+// entre los dos estados, y que la mezcla registrada se deshace
+int test_merge(void)
+{
+	nfa_t* dense = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* sparse = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* before = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_merge_log_t* log = (nfa_merge_log_t*)malloc(sizeof(nfa_merge_log_t));
+	nfa_merge_log_init(log, 3);
+	nfa_init(dense, 3);
+	nfa_init(sparse, 3);
+	nfa_init(before, 3);
+	uint32_t rng = 7;
+	int errors = 0;
+	int round;
+	for (round = 0; round < 200; round++)
+	{
+		state_t states = 2 + round % 10;
+		nfa_free(dense);
+		int k;
+		for (k = 0; k < 4 * states; k++)
+		{
+			rng = rng * 1103515245u + 12345u;
+			nfa_add_transition(dense, (rng >> 8) % states, (rng >> 16) % states, (rng >> 24) % 3);
+		}
+		nfa_set_sparse(dense, false);
+		nfa_add_initial(dense, 0);
+		nfa_add_final(dense, states - 1);
+		nfa_clone(before, dense);
+		nfa_clone(sparse, dense);
+		nfa_set_sparse(sparse, true);
+
+		rng = rng * 1103515245u + 12345u;
+		state_t q1 = (rng >> 8) % states;
+		state_t q2 = (q1 + 1 + (rng >> 16) % (states - 1)) % states;
+		nfa_merge_states(sparse, q1, q2);
+		nfa_merge_states_logged(dense, q1, q2, log);
+		if (!test_same_nfa(dense, sparse))
+		{
+			printf("test: dense merge differs from sparse merge\n");
+			errors++;
+		}
+		nfa_merge_rollback(dense, log);
+		if (!test_same_nfa(dense, before))
+		{
+			printf("test: dense merge rollback differs\n");
+			errors++;
+		}
+	}
+	nfa_free(dense);
+	nfa_free(sparse);
+	nfa_free(before);
+	free(dense);
+	free(sparse);
+	free(before);
+	nfa_merge_log_free(log);
+	free(log);
+	return errors;
+}
+
+// Comprueba que la disposicion por simbolo reconoce las mismas secuencias,
+// que nfa_step da la union de los sucesores y que la mezcla registrada y su
+// reversion dan el mismo automata que con la disposicion por estado
+int test_symbol_major(void)
+{
+	nfa_t* nfa = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* matrix = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* before = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_merge_log_t* log = (nfa_merge_log_t*)malloc(sizeof(nfa_merge_log_t));
+	nfa_merge_log_init(log, 3);
+	nfa_init(nfa, 3);
+	nfa_init(matrix, 3);
+	nfa_init(before, 3);
+	uint32_t rng = 11;
+	int errors = 0;
+	// sin tablas densas no hay disposicion por simbolo
+#ifndef NFA_NO_DENSE
+	int round;
+	for (round = 0; round < 100; round++)
+	{
+		state_t states = 2 + (state_t)(round * 7 % (MAX_STATES - 1));
+		nfa_free(nfa);
+		int k;
+		for (k = 0; k < 3 * states; k++)
+		{
+			rng = rng * 1103515245u + 12345u;
+			nfa_add_transition(nfa, (rng >> 8) % states, (rng >> 16) % states, (rng >> 24) % 3);
+		}
+		nfa_add_initial(nfa, 0);
+		nfa_add_final(nfa, states - 1);
+		nfa_clone(matrix, nfa);
+		nfa_set_sparse(matrix, false);
+		nfa_set_symbol_major(matrix, true);
+		bool same = nfa_is_symbol_major(matrix) && test_same_nfa(matrix, nfa);
+
+		symbol_t word[16];
+		for (k = 0; k < 20; k++)
+		{
+			int i;
+			for (i = 0; i < 16; i++)
+			{
+				rng = rng * 1103515245u + 12345u;
+				word[i] = (rng >> 16) % 3;
+			}
+			same = same && nfa_accept_sample(matrix, word, 1 + k % 16) ==
+				nfa_accept_sample(nfa, word, 1 + k % 16);
+		}
+
+		bitset_t current;
+		bitset_t next;
+		bitset_t expected;
+		bitset_init(&current);
+		bitset_init(&expected);
+		state_t q;
+		for (q = 0; q < states; q++)
+		{
+			rng = rng * 1103515245u + 12345u;
+			if ((rng >> 16) & 1) bitset_add(&current, q);
+		}
+		for (q = 0; q < states; q++)
+		{
+			if (!bitset_contains(&current, q)) continue;
+			bitset_t succ;
+			nfa_get_sucessors(nfa, q, 1, &succ);
+			bitset_union(&expected, &succ);
+		}
+		nfa_step(matrix, &current, 1, &next);
+		same = same && bitset_equals(&next, &expected);
+
+		rng = rng * 1103515245u + 12345u;
+		state_t q1 = (rng >> 8) % states;
+		state_t q2 = (q1 + 1 + (rng >> 16) % (states - 1)) % states;
+		nfa_clone(before, matrix);
+		nfa_merge_states(nfa, q1, q2);
+		nfa_merge_states_logged(matrix, q1, q2, log);
+		same = same && test_same_nfa(matrix, nfa);
+		nfa_merge_rollback(matrix, log);
+		same = same && test_same_nfa(matrix, before);
+
+		nfa_set_symbol_major(matrix, false);
+		same = same && !nfa_is_symbol_major(matrix) && test_same_nfa(matrix, before);
+		if (!same)
+		{
+			printf("test: symbol major layout differs\n");
+			errors++;
+		}
+	}
+#endif
+	nfa_free(nfa);
+	nfa_free(matrix);
+	nfa_free(before);
+	free(nfa);
+	free(matrix);
+	free(before);
+	nfa_merge_log_free(log);
+	free(log);
+	return errors;
+}
+
+// Comprueba que la representacion dispersa y la densa dan el mismo automata
+// al agregar y eliminar transiciones, al copiarlo y al simular muestras,
+// una a una y por lotes, y que las listas llenas pasan a la densa sin perder
+// transiciones. Con NFA_NO_DENSE la transicion que no cabe se rechaza
+int test_dense(void)
+{
+	nfa_t* sparse = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* dense = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_t* copy = (nfa_t*)malloc(sizeof(nfa_t));
+	nfa_init(sparse, 3);
+	nfa_init(dense, 3);
+	nfa_init(copy, 3);
+	uint32_t rng = 13;
+	int errors = 0;
+#ifndef NFA_NO_DENSE
+	int round;
+	for (round = 0; round < 50; round++)
+	{
+		state_t states = 2 + (state_t)(round * 5 % (MAX_STATES - 1));
+		nfa_free(sparse);
+		nfa_free(dense);
+		bool same = nfa_set_sparse(dense, false);
+		int k;
+		for (k = 0; k < 4 * states; k++)
+		{
+			rng = rng * 1103515245u + 12345u;
+			state_t q0 = (rng >> 8) % states;
+			state_t q1 = (rng >> 16) % states;
+			symbol_t a = (rng >> 24) % 3;
+			same = same && nfa_add_transition(sparse, q0, q1, a) &&
+				nfa_add_transition(dense, q0, q1, a);
+		}
+		// la mitad de los intentos elimina una transicion existente
+		nfa_set_sparse(sparse, true);
+		for (k = 0; k < 2 * states; k++)
+		{
+			rng = rng * 1103515245u + 12345u;
+			state_t q0 = (rng >> 8) % states;
+			state_t q1 = (rng >> 16) % states;
+			symbol_t a = (rng >> 24) % 3;
+			nfa_remove_transition(sparse, q0, q1, a);
+			nfa_remove_transition(dense, q0, q1, a);
+		}
+		state_t q;
+		for (q = 0; q < states; q++)
+		{
+			rng = rng * 1103515245u + 12345u;
+			if ((rng >> 8) % 4 == 0)
+			{
+				nfa_add_initial(sparse, q);
+				nfa_add_initial(dense, q);
+			}
+			if ((rng >> 16) % 3 == 0)
+			{
+				nfa_add_final(sparse, q);
+				nfa_add_final(dense, q);
+			}
+		}
+		same = same && nfa_is_sparse(sparse) && !nfa_is_sparse(dense) &&
+			test_same_nfa(sparse, dense);
+
+		// palabras de 16 simbolos, simuladas tambien como un lote de 16
+		symbol_t word[16 * 16];
+		uint32_t offset[16];
+		for (k = 0; k < 16 * 16; k++)
+		{
+			rng = rng * 1103515245u + 12345u;
+			word[k] = (rng >> 16) % 3;
+		}
+		for (k = 0; k < 16; k++)
+		{
+			offset[k] = 16 * k;
+			same = same && nfa_accept_sample(sparse, &word[16 * k], 1 + k) ==
+				nfa_accept_sample(dense, &word[16 * k], 1 + k);
+		}
+		same = same && nfa_accept_batch(sparse, word, offset, 16, 16) ==
+			nfa_accept_batch(dense, word, offset, 16, 16);
+
+		// la copia conserva la representacion de la fuente, y con NFA_HEAP_DENSE
+		// al copiar una dispersa se liberan las tablas que tenia el destino
+		same = same && nfa_clone(copy, dense) && !nfa_is_sparse(copy) &&
+			test_same_nfa(copy, sparse);
+		same = same && nfa_clone(copy, sparse) && nfa_is_sparse(copy) &&
+			test_same_nfa(copy, dense);
+#ifdef NFA_HEAP_DENSE
+		same = same && copy->forward == NULL && copy->backward == NULL;
+#endif
+		if (!same)
+		{
+			printf("test: sparse and dense representations differ\n");
+			errors++;
+		}
+	}
+#endif
+
+	// transiciones distintas hasta que las listas no alcanzan
+	nfa_free(sparse);
+	uint32_t added = 0;
+	bool accepted = true;
+	while (accepted && nfa_is_sparse(sparse) && added <= MAX_SPARSE_EDGES)
+	{
+		state_t q0 = (state_t)(added / (3u * MAX_STATES));
+		state_t q1 = (state_t)(added / 3u % MAX_STATES);
+		accepted = nfa_add_transition(sparse, q0, q1, added % 3u);
+		if (accepted) added++;
+	}
+	uint32_t t;
+	for (t = 0; t < added; t++)
+	{
+		if (!nfa_has_transition(sparse, (state_t)(t / (3u * MAX_STATES)),
+			(state_t)(t / 3u % MAX_STATES), t % 3u)) break;
+	}
+#ifdef NFA_NO_DENSE
+	bool full = !accepted && added == MAX_SPARSE_EDGES;
+#else
+	bool full = accepted && !nfa_is_sparse(sparse) && added <= MAX_SPARSE_EDGES + 1;
+#endif
+	if (!full || t != added)
+	{
+		printf("test: full sparse lists lost or kept a transition\n");
+		errors++;
+	}
+	nfa_free(sparse);
+	nfa_free(dense);
+	nfa_free(copy);
+	free(sparse);
+	free(dense);
+	free(copy);
+	return errors;
+}
+
+// Comprueba que oil_auto usa 64 bits con las muestras de prueba y una
+// anchura mayor con las palabras de 12 simbolos cuya primera mitad es igual
+// a la segunda: las 64 parejas (x, x) obligan a cualquier NFA del lenguaje a
+// tener al menos 64 estados, que no caben en MAX_STATES de 64 bits
+int test_auto(void)
+{
+	int errors = 0;
+	oil_config_t config;
+	oil_config_init(&config);
+	oil_auto_result_t result;
+	model_t model;
+
+	test_samples_t samples;
+	test_samples_init(&samples, 0, 1, false);
+	if (!oil_auto(samples.buffer, sizeof(samples.buffer), 6, 2,
+			samples.pindices, samples.psize, samples.nindices, samples.nsize,
+			&config, &result) ||
+		result.bits != 64 || !model_map(&model, result.model, result.model_size))
+	{
+		printf("test: oil_auto did not learn the samples with 64 bits\n");
+		errors++;
+	}
+	free(result.model);
+
+	// primero las 64 positivas y luego las 4032 negativas
+	symbol_t* buffer = (symbol_t*)malloc(4096 * 12);
+	uint32_t positives = 0;
+	uint32_t negatives = 64;
+	uint32_t w;
+	for (w = 0; w < 4096; w++)
+	{
+		bool positive = (w & 63) == (w >> 6);
+		symbol_t* word = buffer + 12 * (positive ? positives++ : negatives++);
+		int k;
+		for (k = 0; k < 12; k++)
+		{
+			word[k] = (w >> k) & 1;
+		}
+	}
+	index_t pindex = { 0, 64, 12 };
+	index_t nindex = { 64 * 12, 4032, 12 };
+	bool learned = oil_auto(buffer, 4096 * 12, 12, 2, &pindex, 1, &nindex, 1,
+		&config, &result);
+	if (!learned || result.bits <= 64 || result.states < 64 ||
+		!model_map(&model, result.model, result.model_size))
+	{
+		printf("test: oil_auto did not fall back to a wider bitset\n");
+		errors++;
+	}
+	else
+	{
+		int differences = 0;
+		for (w = 0; w < 4096; w++)
+		{
+			if (model_accept_sample(&model, buffer + 12 * w, 12) != (w < 64)) differences++;
+		}
+		if (differences > 0)
+		{
+			printf("test: oil_auto model differs on %d samples\n", differences);
+			errors++;
+		}
+	}
+	free(result.model);
+	free(buffer);
+	return errors;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -45,7 +1366,28 @@ int main(void)
 {
 	_conformance_check_bitset();
 	_conformance_check_nfa();
-	test();
-	return 0;
+	int errors = test();
+	errors += test_dfa();
+	errors += test_classify();
+	errors += test_model();
+	errors += test_reduce();
+	errors += test_cache();
+	errors += test_no_random_sort();
+	errors += test_oil_reduce();
+	errors += test_threads();
+	errors += test_kill_order();
+	errors += test_trie();
+	errors += test_restarts();
+#ifdef OIL_METRICS
+	errors += test_metrics();
+#endif
+	errors += test_checkpoint();
+	errors += test_learner();
+	errors += test_alphabet();
+	errors += test_merge();
+	errors += test_symbol_major();
+	errors += test_dense();
+	errors += test_auto();
+	return errors == 0 ? 0 : 1;
 }
 
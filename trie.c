@@ -0,0 +1,297 @@
+// trie.c
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene un indice de prefijos comunes (trie) sobre un
+// conjunto de muestras.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M. 
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata 
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+#include "trie.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Compara dos muestras lexicograficamente, a igualdad por ordinal
+int sample_trie_compare(const symbol_t* sample_buffer, uint16_t sample_length,
+	const uint32_t* offset, uint32_t a, uint32_t b)
+{
+	int r = memcmp(sample_buffer + offset[a], sample_buffer + offset[b], sample_length);
+	if (r != 0) return r;
+	return a < b ? -1 : 1;
+}
+
+// Ordena los ordinales en order[0..n) segun el contenido de las muestras.
+// Ordenamiento por mezcla, usa tmp como espacio auxiliar
+void sample_trie_sort(const symbol_t* sample_buffer, uint16_t sample_length,
+	const uint32_t* offset, uint32_t* order, uint32_t* tmp, uint32_t n)
+{
+	uint32_t width;
+	for (width = 1; width < n; width *= 2)
+	{
+		uint32_t lo;
+		for (lo = 0; lo < n; lo += 2 * width)
+		{
+			uint32_t mid = lo + width < n ? lo + width : n;
+			uint32_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+			uint32_t i = lo, j = mid, k = lo;
+			while (i < mid && j < hi)
+			{
+				if (sample_trie_compare(sample_buffer, sample_length, offset,
+					order[i], order[j]) <= 0)
+				{
+					tmp[k++] = order[i++];
+				}
+				else
+				{
+					tmp[k++] = order[j++];
+				}
+			}
+			while (i < mid) tmp[k++] = order[i++];
+			while (j < hi) tmp[k++] = order[j++];
+		}
+		memcpy(order, tmp, n * sizeof(uint32_t));
+	}
+}
+
+// Construye el indice de las muestras descritas por indices[0..i_size).
+// Retorna false si no hay memoria suficiente
+bool sample_trie_build(sample_trie_t* trie,
+	const symbol_t* sample_buffer,
+	const uint16_t sample_length,
+	const index_t* indices, const uint16_t i_size)
+{
+	memset(trie, 0, sizeof(sample_trie_t));
+	trie->sample_length = sample_length;
+
+	uint32_t n = 0;
+	uint16_t k;
+	for (k = 0; k < i_size; k++)
+	{
+		n += indices[k].samples;
+	}
+	trie->samples = n;
+
+	// como maximo un nodo por simbolo mas la raiz
+	size_t max_nodes = (size_t)n * sample_length + 1;
+	uint32_t* offset = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+	uint32_t* tmp = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+	uint32_t* path = (uint32_t*)malloc((sample_length + 1) * sizeof(uint32_t));
+	trie->ordinal = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+	trie->symbol = (symbol_t*)malloc(max_nodes * sizeof(symbol_t));
+	trie->depth = (uint16_t*)malloc(max_nodes * sizeof(uint16_t));
+	trie->end = (uint32_t*)malloc(max_nodes * sizeof(uint32_t));
+	trie->sample = (uint32_t*)malloc((max_nodes + 1) * sizeof(uint32_t));
+	trie->max_ordinal = (uint32_t*)malloc(max_nodes * sizeof(uint32_t));
+	trie->parent = (uint32_t*)malloc(max_nodes * sizeof(uint32_t));
+	trie->live = (uint32_t*)malloc(max_nodes * sizeof(uint32_t));
+	trie->leaf = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+	bool ok = offset && tmp && path && trie->ordinal && trie->symbol &&
+		trie->depth && trie->end && trie->sample && trie->max_ordinal &&
+		trie->parent && trie->live && trie->leaf;
+	if (!ok)
+	{
+		free(offset);
+		free(tmp);
+		free(path);
+		sample_trie_free(trie);
+		return false;
+	}
+
+	sample_iterator_t i;
+	uint32_t o = 0;
+	for (i = sample_iterator_begin(); !sample_iterator_equals(i, sample_iterator_end(i_size));
+		i = sample_iterator_next(indices, i))
+	{
+		index_t desc = indices[i.index];
+		offset[o] = desc.begin + desc.stride * i.sample;
+		trie->ordinal[o] = o;
+		o++;
+	}
+	sample_trie_sort(sample_buffer, sample_length, offset, trie->ordinal, tmp, n);
+
+	// raiz
+	trie->nodes = 1;
+	trie->symbol[0] = 0;
+	trie->depth[0] = 0;
+	trie->sample[0] = 0;
+	trie->max_ordinal[0] = 0;
+	trie->parent[0] = 0;
+	trie->live[0] = 0;
+	path[0] = 0;
+	uint16_t path_length = 1;
+
+	// las muestras ordenadas se insertan en preorden: se comparte el prefijo
+	// comun con la muestra anterior y se crean nodos para el resto
+	const symbol_t* previous = NULL;
+	uint32_t s;
+	for (s = 0; s < n; s++)
+	{
+		uint32_t ord = trie->ordinal[s];
+		const symbol_t* sample = sample_buffer + offset[ord];
+		uint16_t common = 0;
+		if (previous != NULL)
+		{
+			while (common < sample_length && previous[common] == sample[common]) common++;
+		}
+		// cierra los subarboles que ya no son parte del camino
+		while (path_length > common + 1)
+		{
+			trie->end[path[--path_length]] = trie->nodes;
+		}
+		uint16_t d;
+		for (d = common; d < sample_length; d++)
+		{
+			uint32_t node = trie->nodes++;
+			trie->symbol[node] = sample[d];
+			trie->depth[node] = d + 1;
+			trie->sample[node] = s;
+			trie->max_ordinal[node] = 0;
+			trie->parent[node] = path[path_length - 1];
+			trie->live[node] = 0;
+			path[path_length++] = node;
+		}
+		for (d = 0; d < path_length; d++)
+		{
+			if (trie->max_ordinal[path[d]] < ord) trie->max_ordinal[path[d]] = ord;
+			trie->live[path[d]]++;
+		}
+		trie->leaf[ord] = path[path_length - 1];
+		previous = sample;
+	}
+	while (path_length > 0)
+	{
+		trie->end[path[--path_length]] = trie->nodes;
+	}
+	trie->sample[trie->nodes] = n;
+
+	free(offset);
+	free(tmp);
+	free(path);
+	return true;
+}
+
+// Libera la memoria del indice
+void sample_trie_free(sample_trie_t* trie)
+{
+	free(trie->symbol);
+	free(trie->depth);
+	free(trie->end);
+	free(trie->sample);
+	free(trie->max_ordinal);
+	free(trie->ordinal);
+	free(trie->parent);
+	free(trie->live);
+	free(trie->leaf);
+	memset(trie, 0, sizeof(sample_trie_t));
+}
+
+// Retira la muestra con el ordinal indicado, de manera que sample_trie_accept
+// puede omitir los subarboles sin muestras. Solo debe retirarse una muestra
+// cuyo resultado ya no le interese al llamador
+void sample_trie_remove(sample_trie_t* trie, uint32_t ordinal)
+{
+	uint32_t n = trie->leaf[ordinal];
+	for (;;)
+	{
+		trie->live[n]--;
+		if (n == 0) break;
+		n = trie->parent[n];
+	}
+}
+
+// Cantidad de muestras del subarbol del nodo con ordinal mayor o igual a first
+uint32_t sample_trie_count(const sample_trie_t* trie, uint32_t node, uint32_t first)
+{
+	uint32_t begin = trie->sample[node];
+	uint32_t end = trie->sample[trie->end[node]];
+	if (first == 0) return end - begin;
+
+	uint32_t c = 0;
+	uint32_t s;
+	for (s = begin; s < end; s++)
+	{
+		if (trie->ordinal[s] >= first) c++;
+	}
+	return c;
+}
+
+// Indica cuantas muestras con ordinal mayor o igual a first tienen el
+// resultado indicado por accept. Si stop_on_first se detiene en la primera.
+// Equivale a nfa_accept_samples_generic sobre las mismas muestras
+int sample_trie_accept(const sample_trie_t* trie,
+	const nfa_t* nfa,
+	uint32_t first,
+	bool stop_on_first, bool accept)
+{
+	if (trie->live[0] == 0 || trie->max_ordinal[0] < first) return 0;
+
+	// conjunto de estados alcanzado por el prefijo de cada profundidad. Las
+	// muestras largas usan memoria dinamica para no agotar la pila del hilo
+	bitset_t stack[SAMPLE_TRIE_STACK_DEPTH];
+	bitset_t* set = stack;
+	if (trie->sample_length >= SAMPLE_TRIE_STACK_DEPTH)
+	{
+		set = (bitset_t*)malloc((trie->sample_length + 1) * sizeof(bitset_t));
+		if (set == NULL) return -1;
+	}
+	bitset_t finals;
+
+	int c = 0;
+	nfa_get_initials(nfa, &set[0]);
+	nfa_get_finals(nfa, &finals);
+
+	uint32_t n = 1;
+	while (n < trie->nodes)
+	{
+		// subarbol sin muestras de interes
+		if (trie->live[n] == 0 || trie->max_ordinal[n] < first)
+		{
+			n = trie->end[n];
+			continue;
+		}
+
+		uint16_t d = trie->depth[n];
+		symbol_t sym = trie->symbol[n];
+		const bitset_t* current = &set[d - 1];
+		bitset_t* next = &set[d];
+		nfa_step(nfa, current, sym, next);
+
+		bool decided = false;
+		bool accepted = false;
+		if (!bitset_any(next))
+		{
+			// todas las muestras del subarbol son rechazadas
+			decided = true;
+		}
+		else if (d == trie->sample_length)
+		{
+			bitset_t tmp = *next;
+			bitset_intersect(&tmp, &finals);
+			accepted = bitset_any(&tmp);
+			decided = true;
+		}
+
+		if (!decided)
+		{
+			n++;
+			continue;
+		}
+		if (accepted == accept)
+		{
+			c += sample_trie_count(trie, n, first);
+			if (stop_on_first && c > 0)
+			{
+				c = 1;
+				break;
+			}
+		}
+		n = trie->end[n];
+	}
+	if (set != stack) free(set);
+	return c;
+}
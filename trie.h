@@ -0,0 +1,96 @@
+// trie.h
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene un indice de prefijos comunes (trie) sobre un
+// conjunto de muestras. Permite comprobar todas las muestras contra un NFA
+// simulando una sola vez cada prefijo compartido.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M. 
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata 
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+//------------------------------------------------------------------------------
+#pragma once
+#include "nfa.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+// Profundidad hasta la cual sample_trie_accept guarda en la pila los
+// conjuntos de estados de cada prefijo
+#ifndef SAMPLE_TRIE_STACK_DEPTH
+#define SAMPLE_TRIE_STACK_DEPTH 64u
+#endif
+
+// Indice de prefijos de un conjunto de muestras de igual longitud.
+// Los nodos se guardan en preorden: el nodo 0 es la raiz (prefijo vacio) y
+// el subarbol de un nodo n ocupa los nodos [n, end[n]). Las muestras se
+// ordenan lexicograficamente, de manera que las muestras de un subarbol
+// tambien son contiguas: [sample[n], sample[end[n]])
+typedef struct _sample_trie_t
+{
+	// Longitud de las muestras, es la profundidad de las hojas
+	uint16_t sample_length;
+
+	// Cantidad de nodos
+	uint32_t nodes;
+
+	// Cantidad de muestras
+	uint32_t samples;
+
+	// Simbolo que lleva del padre a cada nodo
+	symbol_t* symbol;
+
+	// Profundidad de cada nodo
+	uint16_t* depth;
+
+	// Fin del subarbol de cada nodo
+	uint32_t* end;
+
+	// Primera muestra (en orden lexicografico) del subarbol de cada nodo.
+	// Tiene nodes + 1 entradas, la ultima es samples
+	uint32_t* sample;
+
+	// Mayor ordinal de las muestras del subarbol de cada nodo
+	uint32_t* max_ordinal;
+
+	// Ordinal de cada muestra en orden lexicografico. El ordinal es la
+	// posicion de la muestra al recorrer los indices con sample_iterator_t
+	uint32_t* ordinal;
+
+	// Nodo padre de cada nodo, el de la raiz es 0
+	uint32_t* parent;
+
+	// Muestras del subarbol de cada nodo que no han sido retiradas
+	uint32_t* live;
+
+	// Hoja de la muestra con cada ordinal
+	uint32_t* leaf;
+} sample_trie_t;
+
+// Construye el indice de las muestras descritas por indices[0..i_size).
+// Retorna false si no hay memoria suficiente
+bool sample_trie_build(sample_trie_t* trie,
+	const symbol_t* sample_buffer,
+	const uint16_t sample_length,
+	const index_t* indices, const uint16_t i_size);
+
+// Libera la memoria del indice
+void sample_trie_free(sample_trie_t* trie);
+
+// Retira la muestra con el ordinal indicado, de manera que sample_trie_accept
+// puede omitir los subarboles sin muestras. Solo debe retirarse una muestra
+// cuyo resultado ya no le interese al llamador
+void sample_trie_remove(sample_trie_t* trie, uint32_t ordinal);
+
+// Indica cuantas muestras con ordinal mayor o igual a first tienen el
+// resultado indicado por accept. Si stop_on_first se detiene en la primera.
+// Las muestras retiradas pueden contarse o no. Equivale a nfa_accept_samples_generic sobre las mismas muestras.
+// Retorna -1 si no hay memoria suficiente
+int sample_trie_accept(const sample_trie_t* trie,
+	const nfa_t* nfa,
+	uint32_t first,
+	bool stop_on_first, bool accept);
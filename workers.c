@@ -0,0 +1,116 @@
+// workers.c
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene un conjunto de hilos de trabajo para ejecutar en
+// paralelo las partes del algoritmo que corren en el procesador anfitrion.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M. 
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata 
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+#include "workers.h"
+#include <assert.h>
+
+// Ciclo de cada hilo: espera una nueva generacion, ejecuta la tarea y avisa
+void* workers_main(void* p)
+{
+	workers_arg_t* arg = (workers_arg_t*)p;
+	workers_t* w = arg->w;
+	unsigned seen = 0;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;)
+	{
+		while (!w->quit && w->generation == seen)
+		{
+			pthread_cond_wait(&w->start, &w->lock);
+		}
+		if (w->quit) break;
+		seen = w->generation;
+		workers_task_t task = w->task;
+		void* ctx = w->ctx;
+		pthread_mutex_unlock(&w->lock);
+
+		task(ctx, arg->worker);
+
+		pthread_mutex_lock(&w->lock);
+		if (--w->pending == 0)
+		{
+			pthread_cond_signal(&w->done);
+		}
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+// Crea count hilos de trabajo. Retorna false si no se pudieron crear
+bool workers_init(workers_t* w, int count)
+{
+	assert(count >= 1 && count <= MAX_WORKERS);
+
+	w->count = 1;
+	w->task = NULL;
+	w->ctx = NULL;
+	w->generation = 0;
+	w->pending = 0;
+	w->quit = false;
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->start, NULL);
+	pthread_cond_init(&w->done, NULL);
+
+	int i;
+	for (i = 1; i < count; i++)
+	{
+		workers_arg_t* arg = &w->args[i];
+		arg->w = w;
+		arg->worker = i;
+		if (pthread_create(&w->threads[i], NULL, workers_main, arg) != 0) break;
+		w->count++;
+	}
+	return w->count == count;
+}
+
+// Ejecuta la tarea en todos los hilos y espera a que terminen
+void workers_run(workers_t* w, workers_task_t task, void* ctx)
+{
+	pthread_mutex_lock(&w->lock);
+	w->task = task;
+	w->ctx = ctx;
+	w->pending = w->count - 1;
+	w->generation++;
+	pthread_cond_broadcast(&w->start);
+	pthread_mutex_unlock(&w->lock);
+
+	// el hilo que invoca es el hilo 0
+	task(ctx, 0);
+
+	pthread_mutex_lock(&w->lock);
+	while (w->pending > 0)
+	{
+		pthread_cond_wait(&w->done, &w->lock);
+	}
+	pthread_mutex_unlock(&w->lock);
+}
+
+// Termina los hilos de trabajo
+void workers_destroy(workers_t* w)
+{
+	pthread_mutex_lock(&w->lock);
+	w->quit = true;
+	pthread_cond_broadcast(&w->start);
+	pthread_mutex_unlock(&w->lock);
+
+	int i;
+	for (i = 1; i < w->count; i++)
+	{
+		pthread_join(w->threads[i], NULL);
+	}
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->start);
+	pthread_cond_destroy(&w->done);
+	w->count = 1;
+}
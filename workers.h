@@ -0,0 +1,62 @@
+// workers.h
+
+// Implementacion del algoritmo OIL usando lenguaje C con el fin de
+// ser sintetizable en hardware.
+// Este archivo contiene un conjunto de hilos de trabajo para ejecutar en
+// paralelo las partes del algoritmo que corren en el procesador anfitrion.
+// No es sintetizable, requiere pthreads.
+// OIL es un algoritmo publicado por vez primera en P. Garcia, M. 
+// Vazquez de Parga, G. I. Alvarez, and J. Ruiz, "Universal automata 
+// and NFA learning," Theoretical Computer Science, vol. 407, no. 1–3,
+// pp. 192–202, Nov. 2008. [http://dx.doi.org/10.1016/j.tcs.2008.05.017]
+
+// 2014, Jairo Andres Velasco R, [jairov_at_javerianacali.edu.co]
+// Grupo de investigacion DESTINO
+// Pontificia Universidad Javeriana Cali
+//------------------------------------------------------------------------------
+#pragma once
+#include <pthread.h>
+#include <stdbool.h>
+
+// Cantidad maxima de hilos de trabajo
+#define MAX_WORKERS 64
+
+// Tarea que ejecuta cada hilo. worker es el numero del hilo, de 0 a count-1
+typedef void (*workers_task_t)(void* ctx, int worker);
+
+struct _workers_t;
+
+// Argumento que recibe cada hilo al ser creado
+typedef struct _workers_arg_t
+{
+	struct _workers_t* w;
+	int worker;
+} workers_arg_t;
+
+// Conjunto de hilos de trabajo. El hilo que invoca workers_run participa
+// como el hilo 0, por lo que solo se crean count-1 hilos
+typedef struct _workers_t
+{
+	int count;
+	pthread_t threads[MAX_WORKERS];
+	workers_arg_t args[MAX_WORKERS];
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	workers_task_t task;
+	void* ctx;
+	// Se incrementa cada vez que se publica una tarea
+	unsigned generation;
+	// Hilos que aun no terminan la tarea actual
+	int pending;
+	bool quit;
+} workers_t;
+
+// Crea count hilos de trabajo. Retorna false si no se pudieron crear
+bool workers_init(workers_t* w, int count);
+
+// Ejecuta la tarea en todos los hilos y espera a que terminen
+void workers_run(workers_t* w, workers_task_t task, void* ctx);
+
+// Termina los hilos de trabajo
+void workers_destroy(workers_t* w);